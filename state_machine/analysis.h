@@ -0,0 +1,176 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "state_machine.h"
+#include "types/resolve.h"
+#include "types/types.h"
+#include "types/util.h"
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace state_machine
+{
+
+// Target of an action the analysis knows nothing about: it may lead to any
+// state. Custom actions can declare their targets with a targets() overload
+// found by argument-dependent lookup.
+struct any_target
+{
+};
+
+template<typename Action>
+constexpr auto targets(types<Action>)
+{
+    return types<any_target>{};
+}
+
+template<typename State, typename Factory>
+constexpr auto targets(types<transition_to<State, Factory>>)
+{
+    return types<entry_state_t<State>>{};
+}
+
+constexpr auto targets(types<nothing>)
+{
+    return types<>{};
+}
+
+template<typename... Actions>
+constexpr auto targets(types<one_of<Actions...>>)
+{
+    return (types<>{} + ... + targets(types<Actions>{}));
+}
+
+template<typename Action>
+constexpr auto targets(types<maybe<Action>>)
+{
+    return targets(types<Action>{});
+}
+
+template<std::size_t StateCount, std::size_t EventCount>
+struct machine_analysis
+{
+    // edges[from][to]: some event may move the machine from one state to another
+    std::array<std::array<bool, StateCount>, StateCount> edges{};
+    // ignored[state][event]: the pair always resolves to nothing
+    std::array<std::array<bool, EventCount>, StateCount> ignored{};
+    // reachable from the initial (first) state
+    std::array<bool, StateCount> reachable{};
+    // no event leads out of the state
+    std::array<bool, StateCount> absorbing{};
+};
+
+namespace detail
+{
+
+template<std::size_t N, typename... States, typename... Targets>
+constexpr void mark_targets(std::array<bool, N>& row, types<States...> states, types<Targets...>)
+{
+    if constexpr ((std::is_same_v<Targets, any_target> || ...))
+    {
+        for (auto& edge : row)
+        {
+            edge = true;
+        }
+    }
+    else
+    {
+        static_assert(((index_of<Targets>(types<States...>{}) < sizeof...(States)) && ...),
+                      "an action transitions to a state the machine does not list");
+        ((row[index_of<Targets>(states)] = true), ...);
+    }
+}
+
+template<typename Analysis, typename State, typename... States, typename... Events>
+constexpr void add_row(Analysis&       result,
+                       std::size_t     from,
+                       types<State>,
+                       types<States...> states,
+                       types<Events...>)
+{
+    std::size_t event = 0;
+    (((result.ignored[from][event++] =
+         std::is_same_v<type_of_t<decltype(resolve_action{}(types<State, Events>{}))>, nothing>),
+      mark_targets(result.edges[from], states, targets(resolve_action{}(types<State, Events>{})))),
+     ...);
+}
+
+} // namespace detail
+
+template<typename... States, typename... Events>
+constexpr auto analyze(types<States...> states, types<Events...> events)
+{
+    constexpr std::size_t N = sizeof...(States);
+
+    machine_analysis<N, sizeof...(Events)> result{};
+    std::size_t                            from = 0;
+    (detail::add_row(result, from++, types<States>{}, states, events), ...);
+
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        result.absorbing[i] = true;
+        for (std::size_t j = 0; j < N; ++j)
+        {
+            if (i != j && result.edges[i][j])
+            {
+                result.absorbing[i] = false;
+            }
+        }
+    }
+
+    result.reachable[0] = true;
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            for (std::size_t j = 0; j < N; ++j)
+            {
+                if (result.reachable[i] && result.edges[i][j] && !result.reachable[j])
+                {
+                    result.reachable[j] = changed = true;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+// States reachable from the first one when only Events are delivered
+template<typename Events, typename... States>
+class reachable_states
+{
+    static constexpr auto analysis = analyze(types<States...>{}, Events{});
+
+    template<std::size_t... Idx>
+    static constexpr auto filter(std::index_sequence<Idx...>)
+    {
+        return (types<>{} + ... + std::conditional_t<analysis.reachable[Idx], types<States>, types<>>{});
+    }
+
+  public:
+    using type = decltype(filter(std::make_index_sequence<sizeof...(States)>()));
+};
+
+template<typename Policy, typename StateTypes>
+struct rebind_machine;
+
+template<typename Policy, typename... States>
+struct rebind_machine<Policy, types<States...>>
+{
+    using type = basic_state_machine<Policy, States...>;
+};
+
+// Machine that stores and dispatches over the reachable states only. Events
+// must list every event the machine is going to handle.
+template<typename Policy, typename Events, typename... States>
+using pruned_state_machine =
+  typename rebind_machine<Policy, typename reachable_states<Events, States...>::type>::type;
+
+} // namespace state_machine
+
+#endif // ANALYSIS_H
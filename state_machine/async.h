@@ -0,0 +1,424 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#if !defined(__cpp_impl_coroutine) || __cplusplus < 202002L
+#error "async.h needs C++20 coroutines"
+#endif
+
+#include "types/types.h"
+#include "util/static_string.h"
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace state_machine
+{
+
+// Coroutine frames of async handlers come from thread-local free lists, one
+// per 64-byte size class up to 1 KiB, so once a thread has run a handler
+// its frames are recycled instead of allocated per suspension. Larger
+// frames go to operator new.
+class frame_pool
+{
+  public:
+    static void* allocate(std::size_t size)
+    {
+        const std::size_t index = size_class(size);
+        if (index >= classes)
+        {
+            return ::operator new(size);
+        }
+
+        block*& head = lists().heads[index];
+        if (head == nullptr)
+        {
+            return ::operator new((index + 1) * granularity);
+        }
+        block* b = head;
+        head     = b->next;
+        return b;
+    }
+
+    static void release(void* p, std::size_t size)
+    {
+        const std::size_t index = size_class(size);
+        if (index >= classes)
+        {
+            ::operator delete(p);
+            return;
+        }
+
+        block*& head = lists().heads[index];
+        head         = new (p) block{head};
+    }
+
+  private:
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t classes     = 16;
+
+    struct block
+    {
+        block* next;
+    };
+
+    struct free_lists
+    {
+        std::array<block*, classes> heads{};
+
+        ~free_lists()
+        {
+            for (block* head : heads)
+            {
+                while (head != nullptr)
+                {
+                    ::operator delete(std::exchange(head, head->next));
+                }
+            }
+        }
+    };
+
+    static std::size_t size_class(std::size_t size)
+    {
+        return (size + granularity - 1) / granularity - 1;
+    }
+
+    static free_lists& lists()
+    {
+        thread_local free_lists cache;
+        return cache;
+    }
+};
+
+// Action produced by a coroutine handler. The handler runs when the event
+// is handled, until it first suspends; the Action it co_returns is executed
+// once it finishes. A handler that finishes without suspending executes its
+// action right away. Otherwise the driver passed as machine (async_driver)
+// parks the machine until the coroutine completes.
+//
+// Handlers should take their event by value: a reference parameter would
+// outlive the caller's event once the handler suspends.
+template<typename Action>
+class async
+{
+  public:
+    struct promise_type
+    {
+        std::optional<Action> result;
+        void (*on_done)(void*) = nullptr;
+        void* context          = nullptr;
+
+        // Not an aggregate, so the handler's arguments are never taken as
+        // promise initializers
+        promise_type() = default;
+
+        async get_return_object()
+        {
+            return async{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        auto final_suspend() noexcept
+        {
+            struct notify
+            {
+                bool await_ready() noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    promise_type& p = h.promise();
+                    if (p.on_done != nullptr)
+                    {
+                        p.on_done(p.context);
+                    }
+                }
+
+                void await_resume() noexcept {}
+            };
+            return notify{};
+        }
+
+        template<typename T>
+        void return_value(T&& value)
+        {
+            result.emplace(std::forward<T>(value));
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+
+        static void* operator new(std::size_t size)
+        {
+            return frame_pool::allocate(size);
+        }
+
+        static void operator delete(void* p, std::size_t size)
+        {
+            frame_pool::release(p, size);
+        }
+    };
+
+    using handle = std::coroutine_handle<promise_type>;
+
+    async(async&& other) noexcept
+      : frame(std::exchange(other.frame, {}))
+    {
+    }
+
+    async& operator=(async&&) = delete;
+
+    ~async()
+    {
+        if (frame)
+        {
+            frame.destroy();
+        }
+    }
+
+    template<typename Machine, typename State, typename Event>
+    void execute(Machine& machine, State& state, const Event& event)
+    {
+        if (frame.done())
+        {
+            Action action = std::move(*frame.promise().result);
+            std::exchange(frame, {}).destroy();
+            action.execute(machine, state, event);
+        }
+        else
+        {
+            machine.suspend(std::exchange(frame, {}), state, event);
+        }
+    }
+
+  private:
+    explicit async(handle frame)
+      : frame(frame)
+    {
+    }
+
+    handle frame;
+};
+
+template<typename Action>
+static constexpr auto stringify(types<async<Action>>)
+{
+    return static_string{"async<"} + stringify(types<Action>{}) + static_string{">"};
+}
+
+template<typename Action>
+constexpr auto targets(types<async<Action>>)
+{
+    return targets(types<Action>{});
+}
+
+// One-shot result an async handler can co_await. The producer calls set()
+// on the dispatch thread, which resumes the waiting handler right there.
+// Handlers await the completion itself, never a copy, so it is neither
+// copyable nor movable.
+template<typename T>
+class completion
+{
+  public:
+    completion() = default;
+
+    completion(const completion&) = delete;
+    completion& operator=(const completion&) = delete;
+
+    auto operator co_await() noexcept
+    {
+        struct awaiter
+        {
+            completion& source;
+
+            bool await_ready() const noexcept
+            {
+                return source.value.has_value();
+            }
+
+            void await_suspend(std::coroutine_handle<> h) noexcept
+            {
+                source.waiter = h;
+            }
+
+            T await_resume()
+            {
+                return std::move(*std::exchange(source.value, std::nullopt));
+            }
+        };
+        return awaiter{*this};
+    }
+
+    void set(T result)
+    {
+        value.emplace(std::move(result));
+        if (auto h = std::exchange(waiter, {}))
+        {
+            h.resume();
+        }
+    }
+
+  private:
+    std::optional<T>        value;
+    std::coroutine_handle<> waiter;
+};
+
+// What an async_driver does with events arriving while its machine waits
+// for a handler
+enum class when_suspended
+{
+    queue,
+    reject
+};
+
+// Driver for machines with async handlers, passed to actions in place of
+// the machine like event_queue. While a handler is suspended, incoming
+// events are queued (up to `capacity`, in a preallocated ring) or rejected;
+// when it completes, its action is executed and the queue drained. Handlers
+// must be resumed on the thread that dispatches to the machine.
+template<typename Machine, typename... Events>
+class async_driver
+{
+  public:
+    using event = std::variant<Events...>;
+
+    explicit async_driver(Machine&       machine,
+                          when_suspended policy   = when_suspended::queue,
+                          std::size_t    capacity = 64)
+      : machine(machine)
+      , policy(policy)
+      , ring(capacity)
+    {
+    }
+
+    async_driver(const async_driver&) = delete;
+    async_driver& operator=(const async_driver&) = delete;
+
+    ~async_driver()
+    {
+        if (frame)
+        {
+            frame.destroy();
+        }
+    }
+
+    template<typename State, typename... Args>
+    State& transition(Args&&... args)
+    {
+        return machine.template transition<State>(std::forward<Args>(args)...);
+    }
+
+    bool suspended() const
+    {
+        return static_cast<bool>(frame);
+    }
+
+    // Stops batches at a suspension
+    bool has_pending() const
+    {
+        return suspended() || queued != 0;
+    }
+
+    std::size_t rejected() const
+    {
+        return rejections;
+    }
+
+    // Returns false when the event was rejected
+    template<typename Event>
+    bool handle(const Event& e)
+    {
+        if (suspended())
+        {
+            return enqueue(e);
+        }
+        machine.handle_by(e, *this);
+        return true;
+    }
+
+    bool handle(const event& e)
+    {
+        return std::visit([this](const auto& alternative) { return handle(alternative); }, e);
+    }
+
+    template<typename Promise, typename State, typename Event>
+    void suspend(std::coroutine_handle<Promise> handler, State& state, const Event& e)
+    {
+        handler.promise().on_done = &completed;
+        handler.promise().context = this;
+        frame                     = handler;
+        parked                    = &state;
+        inflight                  = e;
+        finish                    = &resume<Promise, State, Event>;
+    }
+
+  private:
+    template<typename Event>
+    bool enqueue(const Event& e)
+    {
+        if (policy == when_suspended::reject || queued == ring.size())
+        {
+            ++rejections;
+            return false;
+        }
+        ring[(head + queued++) % ring.size()] = e;
+        return true;
+    }
+
+    static void completed(void* self)
+    {
+        auto& driver = *static_cast<async_driver*>(self);
+        driver.finish(driver);
+        driver.drain();
+    }
+
+    template<typename Promise, typename State, typename Event>
+    static void resume(async_driver& driver)
+    {
+        auto handler = std::coroutine_handle<Promise>::from_address(driver.frame.address());
+        auto action  = std::move(*handler.promise().result);
+        driver.frame = {};
+        handler.destroy();
+        action.execute(driver, *static_cast<State*>(driver.parked), std::get<Event>(driver.inflight));
+    }
+
+    void drain()
+    {
+        while (!suspended() && queued != 0)
+        {
+            event next = std::move(ring[head]);
+            head       = (head + 1) % ring.size();
+            --queued;
+            std::visit([this](const auto& e) { machine.handle_by(e, *this); }, next);
+        }
+    }
+
+    Machine&                machine;
+    const when_suspended    policy;
+    std::vector<event>      ring;
+    std::size_t             head       = 0;
+    std::size_t             queued     = 0;
+    std::size_t             rejections = 0;
+    std::coroutine_handle<> frame;
+    void*                   parked = nullptr;
+    event                   inflight;
+    void (*finish)(async_driver&) = nullptr;
+};
+
+} // namespace state_machine
+
+#endif // ASYNC_H
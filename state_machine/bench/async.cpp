@@ -0,0 +1,181 @@
+#include "async.h"
+#include "state_machine.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace sm = state_machine;
+
+namespace
+{
+
+std::atomic<std::uint64_t> allocations{0};
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+// Answers key lookups in bulk, the way a completion queue of an I/O
+// service would
+class key_directory
+{
+  public:
+    explicit key_directory(std::size_t machines)
+      : slots(machines)
+    {
+        requested.reserve(machines);
+    }
+
+    sm::completion<std::uint32_t>& lookup(std::size_t id)
+    {
+        requested.push_back(id);
+        return slots[id];
+    }
+
+    std::size_t serve()
+    {
+        const std::size_t served = requested.size();
+        for (std::size_t id : requested)
+        {
+            slots[id].set(static_cast<std::uint32_t>(id * 2654435761u));
+        }
+        requested.clear();
+        return served;
+    }
+
+  private:
+    std::vector<sm::completion<std::uint32_t>> slots;
+    std::vector<std::size_t>                   requested;
+};
+
+struct Lock
+{
+};
+
+struct Unlock
+{
+    std::uint32_t key;
+};
+
+struct Unlocked;
+
+struct Locked : sm::by_default<sm::nothing>
+{
+    using sm::by_default<sm::nothing>::handle;
+
+    Locked() = default;
+
+    Locked(std::size_t id, key_directory& directory)
+      : id(id)
+      , directory(&directory)
+    {
+    }
+
+    sm::async<sm::maybe<sm::transition_to<Unlocked>>> handle(Unlock e)
+    {
+        const std::uint32_t key = co_await directory->lookup(id);
+        if (key == e.key)
+        {
+            co_return sm::transition_to<Unlocked>{};
+        }
+        co_return sm::nothing{};
+    }
+
+    std::size_t    id        = 0;
+    key_directory* directory = nullptr;
+};
+
+struct Unlocked : sm::will<sm::by_default<sm::nothing>, sm::on<Lock, sm::transition_to<Locked>>>
+{
+};
+
+using machine = sm::state_machine<Locked, Unlocked>;
+using driver  = sm::async_driver<machine, Lock, Unlock>;
+
+} // namespace
+
+// Usage: async_bench [machines] [rounds]
+//
+// Every round sends each machine an Unlock, whose handler suspends on a key
+// lookup, and a Lock that arrives while it is suspended and gets queued.
+// Serving the lookups resumes every handler from one dispatch thread.
+int main(int argc, char** argv)
+{
+    const std::size_t count  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    const unsigned    rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+
+    key_directory                        directory{count};
+    std::vector<machine>                 machines;
+    std::vector<std::unique_ptr<driver>> drivers;
+    machines.reserve(count);
+    drivers.reserve(count);
+    for (std::size_t id = 0; id < count; ++id)
+    {
+        machines.emplace_back(Locked{id, directory}, Unlocked{});
+        drivers.push_back(std::make_unique<driver>(machines.back()));
+    }
+
+    std::size_t resumed = 0;
+    auto        round   = [&] {
+        for (std::size_t id = 0; id < count; ++id)
+        {
+            drivers[id]->handle(Unlock{static_cast<std::uint32_t>(id * 2654435761u)});
+            drivers[id]->handle(Lock{});
+        }
+        resumed += directory.serve();
+    };
+
+    // Warms up the frame free lists
+    round();
+
+    const std::uint64_t before = allocations.load();
+    const auto          start  = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        round();
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    const std::uint64_t allocated = allocations.load() - before;
+
+    std::size_t suspended = 0;
+    for (const auto& d : drivers)
+    {
+        suspended += d->suspended();
+    }
+
+    const double cycles = double(count) * rounds;
+    std::cout << std::fixed << std::setprecision(2) << "machines " << count << ", rounds " << rounds
+              << '\n'
+              << "suspend + queue + resume: " << elapsed.count() / cycles << " ns/machine\n"
+              << "allocations per suspension: " << allocated / cycles << std::endl;
+
+    return resumed == count * (rounds + 1) && suspended == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,188 @@
+#include "bulk.h"
+#include "pool.h"
+#include "state_machine.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// Synthetic machine sizes as BENCH_SIZE(states, events) entries
+#ifndef BULK_BENCH_SIZES
+#define BULK_BENCH_SIZES BENCH_SIZE(4, 4) BENCH_SIZE(8, 16) BENCH_SIZE(32, 16)
+#endif
+
+namespace sm = state_machine;
+
+namespace
+{
+
+// Classification-style machine: empty states, and every (state, event)
+// pair either ignored (event 0) or a plain transition
+template<std::size_t StateCount, std::size_t EventCount>
+struct classifier
+{
+    template<std::size_t J>
+    struct event
+    {
+    };
+
+    template<std::size_t I>
+    struct state;
+
+    static constexpr std::size_t target(std::size_t i, std::size_t j)
+    {
+        return (i * 7 + j * 13 + 1) % StateCount;
+    }
+
+    template<std::size_t I, std::size_t J>
+    using action = std::conditional_t<J == 0, sm::nothing, sm::transition_to<state<target(I, J)>>>;
+
+    template<std::size_t I, std::size_t... J>
+    static auto handlers(std::index_sequence<J...>) -> sm::will<sm::on<event<J>, action<I, J>>...>;
+
+    template<std::size_t I>
+    struct state : decltype(handlers<I>(std::make_index_sequence<EventCount>()))
+    {
+    };
+
+    template<std::size_t... I>
+    static auto pool_of(std::index_sequence<I...>) -> sm::machine_pool<state<I>...>;
+
+    using pool = decltype(pool_of(std::make_index_sequence<StateCount>()));
+
+    template<std::size_t... J>
+    static auto events_of(std::index_sequence<J...>) -> sm::types<event<J>...>;
+
+    using events = decltype(events_of(std::make_index_sequence<EventCount>()));
+
+    template<std::size_t... J>
+    static void handle(pool& p, std::size_t id, std::size_t code, std::index_sequence<J...>)
+    {
+        ((code == J && (p.handle(id, event<J>{}), true)) || ...);
+    }
+};
+
+template<typename... Events, typename... States>
+std::size_t step(sm::machine_pool<States...>& pool,
+                 sm::types<Events...>,
+                 const std::uint8_t* events,
+                 std::uint64_t*      fired)
+{
+    return sm::step_pool<Events...>(pool, events, fired);
+}
+
+const char* simd_path(std::size_t entries)
+{
+#if defined(__AVX512BW__) && defined(__AVX512VBMI__)
+    if (entries <= 128)
+    {
+        return "avx512";
+    }
+#endif
+#if defined(__AVX2__)
+    return entries <= 64 ? "shuffle" : "gather";
+#else
+    (void)entries;
+    return "scalar";
+#endif
+}
+
+template<std::size_t StateCount, std::size_t EventCount>
+bool bench(std::size_t count, unsigned rounds)
+{
+    using machine = classifier<StateCount, EventCount>;
+    using pool    = typename machine::pool;
+
+    std::vector<std::vector<std::uint8_t>> streams(rounds, std::vector<std::uint8_t>(count));
+    std::uint64_t                          x = 88172645463325252ull;
+    for (auto& codes : streams)
+    {
+        for (auto& code : codes)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            code = static_cast<std::uint8_t>(x % EventCount);
+        }
+    }
+
+    // The bulk step must agree with stepping every instance through the pool
+    {
+        const std::size_t          sample = std::min<std::size_t>(count, 4096 + 37);
+        pool                       stepped{sample};
+        pool                       handled{sample};
+        std::vector<std::uint64_t> fired((sample + 63) / 64);
+        for (const auto& codes : streams)
+        {
+            step(stepped, typename machine::events{}, codes.data(), fired.data());
+            for (std::size_t id = 0; id < sample; ++id)
+            {
+                machine::handle(handled, id, codes[id], std::make_index_sequence<EventCount>());
+                const bool transition = (codes[id] != 0);
+                if (stepped.current_index(id) != handled.current_index(id)
+                    || ((fired[id / 64] >> id % 64) & 1) != transition)
+                {
+                    std::cout << StateCount << "x" << EventCount << ": mismatch at " << id
+                              << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    constexpr auto table = sm::make_step_table(pool::get_state_types(), typename machine::events{});
+
+    pool                       scalarPool{count};
+    pool                       bulkPool{count};
+    std::vector<std::uint64_t> fired((count + 63) / 64);
+
+    std::size_t scalarFired = 0;
+    auto        start       = std::chrono::steady_clock::now();
+    for (const auto& codes : streams)
+    {
+        scalarFired += sm::step_bulk_scalar(
+          table, scalarPool.state_indices(), codes.data(), count, fired.data());
+    }
+    const std::chrono::duration<double> scalar = std::chrono::steady_clock::now() - start;
+
+    std::size_t bulkFired = 0;
+    start                 = std::chrono::steady_clock::now();
+    for (const auto& codes : streams)
+    {
+        bulkFired += step(bulkPool, typename machine::events{}, codes.data(), fired.data());
+    }
+    const std::chrono::duration<double> bulk = std::chrono::steady_clock::now() - start;
+
+    const double events = double(count) * rounds;
+    std::cout << std::setw(6) << StateCount << std::setw(7) << EventCount << std::setw(9)
+              << simd_path(table.size) << std::fixed << std::setprecision(2) << std::setw(11)
+              << events / scalar.count() / 1e9 << std::setw(11) << events / bulk.count() / 1e9
+              << std::setw(10) << double(bulkFired) / events << std::endl;
+    return scalarFired == bulkFired;
+}
+
+} // namespace
+
+// Usage: bulk_bench [instances] [rounds]
+//
+// Steps a pool of payload-free machines by one event per instance per
+// round, scalar and with the SIMD path this build targets.
+int main(int argc, char** argv)
+{
+    const std::size_t count  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+    const unsigned    rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16;
+
+    std::cout << std::setw(6) << "states" << std::setw(7) << "events" << std::setw(9) << "path"
+              << std::setw(11) << "scalar G/s" << std::setw(11) << "bulk G/s" << std::setw(10)
+              << "fired" << std::endl;
+
+    bool ok = true;
+#define BENCH_SIZE(STATES, EVENTS) ok = bench<STATES, EVENTS>(count, rounds) && ok;
+    BULK_BENCH_SIZES
+#undef BENCH_SIZE
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
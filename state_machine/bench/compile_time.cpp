@@ -0,0 +1,131 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Machine sizes as COMPILE_TIME_SIZE(states, events) entries
+#ifndef COMPILE_TIME_BENCH_SIZES
+#define COMPILE_TIME_BENCH_SIZES COMPILE_TIME_SIZE(8, 8) COMPILE_TIME_SIZE(16, 16)
+#endif
+
+#ifndef COMPILE_TIME_BENCH_COMPILER
+#define COMPILE_TIME_BENCH_COMPILER "c++"
+#endif
+
+#ifndef COMPILE_TIME_BENCH_STD
+#define COMPILE_TIME_BENCH_STD "-std=c++17"
+#endif
+
+#ifndef COMPILE_TIME_BENCH_INCLUDE
+#define COMPILE_TIME_BENCH_INCLUDE "."
+#endif
+
+#ifndef COMPILE_TIME_BENCH_SOURCE
+#define COMPILE_TIME_BENCH_SOURCE "bench/compile_time_machine.cpp"
+#endif
+
+namespace
+{
+
+struct measurement
+{
+    int    status     = -1;
+    double seconds    = 0;
+    long   max_rss_kb = 0;
+};
+
+// Compiles the synthetic machine once, in a child process whose resource
+// usage is collected on exit; compiler diagnostics are discarded
+measurement compile(std::size_t states, std::size_t events, const std::vector<std::string>& flags)
+{
+    std::vector<std::string> args{COMPILE_TIME_BENCH_COMPILER,
+                                  COMPILE_TIME_BENCH_STD,
+                                  "-I" COMPILE_TIME_BENCH_INCLUDE,
+                                  "-DSTATES=" + std::to_string(states),
+                                  "-DEVENTS=" + std::to_string(events),
+                                  "-c",
+                                  COMPILE_TIME_BENCH_SOURCE,
+                                  "-o",
+                                  "/dev/null"};
+    args.insert(args.end(), flags.begin(), flags.end());
+
+    std::vector<char*> argv;
+    for (auto& arg : args)
+    {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    measurement result;
+    const auto  start = std::chrono::steady_clock::now();
+
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        return result;
+    }
+    if (pid == 0)
+    {
+        const int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    int           status = 0;
+    struct rusage usage = {};
+    if (wait4(pid, &status, 0, &usage) != pid)
+    {
+        return result;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.status     = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    result.seconds    = elapsed.count();
+    result.max_rss_kb = usage.ru_maxrss;
+    return result;
+}
+
+void report(std::size_t states, std::size_t events, const measurement& m)
+{
+    std::cout << std::setw(6) << states << std::setw(7) << events << std::setw(8)
+              << states * events << std::fixed << std::setprecision(2) << std::setw(10)
+              << m.seconds << std::setw(10) << m.max_rss_kb / 1024;
+    if (m.status != 0)
+    {
+        std::cout << "  failed (" << m.status << ")";
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+// Extra arguments are passed to the compiler, e.g. compile_time_bench -O2
+int main(int argc, char** argv)
+{
+    const std::vector<std::string> flags(argv + 1, argv + argc);
+
+    std::cout << std::setw(6) << "states" << std::setw(7) << "events" << std::setw(8) << "pairs"
+              << std::setw(10) << "seconds" << std::setw(10) << "max MiB" << std::endl;
+
+    bool ok = true;
+#define COMPILE_TIME_SIZE(STATES, EVENTS)                                  \
+    {                                                                      \
+        const measurement m = compile(STATES, EVENTS, flags);              \
+        report(STATES, EVENTS, m);                                         \
+        ok = ok && m.status == 0;                                          \
+    }
+    COMPILE_TIME_BENCH_SIZES
+#undef COMPILE_TIME_SIZE
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,106 @@
+// Translation unit measured by compile_time_bench: a synthetic machine of
+// STATES states and EVENTS events, its transition tables and its analysis
+#include "analysis.h"
+#include "state_machine.h"
+#include "table.h"
+#include "types/types.h"
+
+#include <cstddef>
+#include <iostream>
+#include <utility>
+
+#ifndef STATES
+#define STATES 16
+#endif
+
+#ifndef EVENTS
+#define EVENTS 16
+#endif
+
+namespace sm = state_machine;
+
+namespace
+{
+
+template<std::size_t J>
+struct event
+{
+};
+
+template<std::size_t I>
+struct state;
+
+constexpr std::size_t target(std::size_t i, std::size_t j)
+{
+    return j == 0 ? i : (i * 7 + j * 13 + 1) % STATES;
+}
+
+// Every third event (0, 3, 6...) is ignored, the others move the machine
+constexpr std::size_t moving_events = EVENTS - (EVENTS + 2) / 3;
+
+// Index of the J-th event that is not a multiple of 3
+constexpr std::size_t moving_event(std::size_t j)
+{
+    return j + j / 2 + 1;
+}
+
+template<std::size_t I, std::size_t... J>
+auto handlers(std::index_sequence<J...>)
+  -> sm::will<sm::by_default<sm::nothing>,
+              sm::on<event<moving_event(J)>, sm::transition_to<state<target(I, moving_event(J))>>>...>;
+
+static_assert(moving_events == 0 || moving_event(moving_events - 1) < EVENTS);
+
+template<std::size_t I>
+struct state : decltype(handlers<I>(std::make_index_sequence<moving_events>()))
+{
+};
+
+template<std::size_t I>
+constexpr auto stringify(sm::types<state<I>>)
+{
+    return static_string{"state"};
+}
+
+template<std::size_t J>
+constexpr auto stringify(sm::types<event<J>>)
+{
+    return static_string{"event"};
+}
+
+template<std::size_t... I>
+constexpr sm::types<state<I>...> states_of(std::index_sequence<I...>)
+{
+    return {};
+}
+
+template<std::size_t... J>
+constexpr sm::types<event<J>...> events_of(std::index_sequence<J...>)
+{
+    return {};
+}
+
+} // namespace
+
+int main()
+{
+    constexpr auto states = states_of(std::make_index_sequence<STATES>());
+    constexpr auto events = events_of(std::make_index_sequence<EVENTS>());
+
+    constexpr auto analysis = sm::analyze(states, events);
+    static_assert(analysis.reachable[0]);
+    static_assert([&analysis] {
+        for (std::size_t e = 0; e < EVENTS; ++e)
+        {
+            if (analysis.ignored[0][e] != (e % 3 == 0))
+            {
+                return false;
+            }
+        }
+        return true;
+    }());
+
+    std::cout << sm::generate_transition_table(states, events).data() << std::endl;
+    std::cout << sm::generate_pretty_transition_table(states, events).data() << std::endl;
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include "perf_counters.h"
+#include "state_machine.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Synthetic machine sizes as BENCH_SIZE(states, events) entries
+#ifndef DISPATCH_BENCH_SIZES
+#define DISPATCH_BENCH_SIZES \
+    BENCH_SIZE(4, 4) BENCH_SIZE(16, 16) BENCH_SIZE(64, 16) BENCH_SIZE(256, 8)
+#endif
+
+namespace sm = state_machine;
+
+namespace
+{
+
+std::uint64_t entered = 0;
+
+template<std::size_t StateCount, std::size_t EventCount>
+struct synthetic
+{
+    template<std::size_t J>
+    struct event
+    {
+    };
+
+    template<std::size_t I>
+    struct state;
+
+    // Event 0 loops on the current state, the others scatter over all states
+    static constexpr std::size_t target(std::size_t i, std::size_t j)
+    {
+        return j == 0 ? i : (i * 7 + j * 13 + 1) % StateCount;
+    }
+
+    template<std::size_t I, std::size_t... J>
+    static auto handlers(std::index_sequence<J...>)
+      -> sm::will<sm::on<event<J>, sm::transition_to<state<target(I, J)>>>...>;
+
+    template<std::size_t I>
+    struct state : decltype(handlers<I>(std::make_index_sequence<EventCount>()))
+    {
+        template<typename Event>
+        void on_enter(const Event&)
+        {
+            ++entered;
+        }
+    };
+
+    template<std::size_t... J>
+    static auto any_event_of(std::index_sequence<J...>) -> std::variant<event<J>...>;
+
+    using any_event = decltype(any_event_of(std::make_index_sequence<EventCount>()));
+
+    template<typename Policy, std::size_t... I>
+    static auto machine_of(std::index_sequence<I...>) -> sm::basic_state_machine<Policy, state<I>...>;
+
+    template<typename Policy>
+    using machine = decltype(machine_of<Policy>(std::make_index_sequence<StateCount>()));
+
+    template<std::size_t... J>
+    static std::array<any_event, EventCount> prototypes(std::index_sequence<J...>)
+    {
+        return {any_event{std::in_place_index<J>}...};
+    }
+};
+
+struct visit_policy : sm::default_policy
+{
+};
+
+struct switch_policy : sm::default_policy
+{
+    using dispatch = sm::table_dispatch<SIZE_MAX>;
+};
+
+struct table_policy : sm::default_policy
+{
+    using dispatch = sm::table_dispatch<0>;
+};
+
+enum class scenario
+{
+    random,
+    skewed,
+    self_loop
+};
+
+const char* name(scenario s)
+{
+    switch (s)
+    {
+        case scenario::random:
+            return "random";
+        case scenario::skewed:
+            return "skewed";
+        case scenario::self_loop:
+            return "self-loop";
+    }
+    return "";
+}
+
+// Event indices: uniform, 90% of a single scattering event, or only the
+// self-loop event
+std::vector<std::size_t> event_indices(scenario s, std::size_t events, std::size_t count)
+{
+    std::vector<std::size_t> result(count);
+    std::uint64_t            x = 88172645463325252ull;
+    for (auto& index : result)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        switch (s)
+        {
+            case scenario::random:
+                index = x % events;
+                break;
+            case scenario::skewed:
+                index = x % 10 != 0 ? 1 % events : x % events;
+                break;
+            case scenario::self_loop:
+                index = 0;
+                break;
+        }
+    }
+    return result;
+}
+
+void header()
+{
+    std::cout << std::setw(6) << "states" << std::setw(7) << "events" << "  " << std::setw(9)
+              << "scenario" << "  " << std::setw(6) << "path" << std::setw(12) << "Mevents/s"
+              << std::setw(10) << "ns/event" << std::setw(11) << "instr/ev" << std::setw(12)
+              << "bmiss/ev" << std::endl;
+}
+
+void report(std::size_t           states,
+            std::size_t           events,
+            scenario              s,
+            const char*           strategy,
+            std::uint64_t         count,
+            double                seconds,
+            perf_counters&        perf,
+            perf_counters::sample sample)
+{
+    std::cout << std::setw(6) << states << std::setw(7) << events << "  " << std::setw(9) << name(s)
+              << "  " << std::setw(6) << strategy << std::fixed << std::setprecision(2)
+              << std::setw(12) << count / seconds / 1e6 << std::setw(10) << seconds * 1e9 / count;
+    if (perf.available())
+    {
+        std::cout << std::setw(11) << double(sample.instructions) / count << std::setw(12)
+                  << double(sample.branch_misses) / count;
+    }
+    else
+    {
+        std::cout << std::setw(11) << "-" << std::setw(12) << "-";
+    }
+    std::cout << std::endl;
+}
+
+template<typename Machine, typename Event>
+void run_single(std::size_t               states,
+                std::size_t               events,
+                scenario                  s,
+                const char*               strategy,
+                const std::vector<Event>& stream,
+                unsigned                  rounds)
+{
+    Machine       machine;
+    perf_counters perf;
+    auto          passToMachine = [&machine](const auto& event) { machine.handle(event); };
+
+    const auto start = std::chrono::steady_clock::now();
+    perf.start();
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        for (const auto& event : stream)
+        {
+            std::visit(passToMachine, event);
+        }
+    }
+    const auto sample  = perf.stop();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    report(states, events, s, strategy, stream.size() * rounds, elapsed.count(), perf, sample);
+}
+
+template<typename Machine, typename Event>
+void run_batch(std::size_t               states,
+               std::size_t               events,
+               scenario                  s,
+               const std::vector<Event>& stream,
+               unsigned                  rounds)
+{
+    Machine       machine;
+    perf_counters perf;
+
+    const auto start = std::chrono::steady_clock::now();
+    perf.start();
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        machine.handle_batch(stream.data(), stream.data() + stream.size());
+    }
+    const auto sample  = perf.stop();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    report(states, events, s, "batch", stream.size() * rounds, elapsed.count(), perf, sample);
+}
+
+template<std::size_t StateCount, std::size_t EventCount>
+void bench(std::size_t count, unsigned rounds)
+{
+    using machine_type = synthetic<StateCount, EventCount>;
+    using any_event    = typename machine_type::any_event;
+
+    const auto prototypes = machine_type::prototypes(std::make_index_sequence<EventCount>());
+
+    for (scenario s : {scenario::random, scenario::skewed, scenario::self_loop})
+    {
+        std::vector<any_event> stream;
+        stream.reserve(count);
+        for (std::size_t index : event_indices(s, EventCount, count))
+        {
+            stream.push_back(prototypes[index]);
+        }
+
+        using visit_machine = typename machine_type::template machine<visit_policy>;
+        run_single<visit_machine>(StateCount, EventCount, s, "visit", stream, rounds);
+        run_single<typename machine_type::template machine<switch_policy>>(
+          StateCount, EventCount, s, "switch", stream, rounds);
+        run_single<typename machine_type::template machine<table_policy>>(
+          StateCount, EventCount, s, "table", stream, rounds);
+        run_batch<visit_machine>(StateCount, EventCount, s, stream, rounds);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t count  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+    const unsigned    rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+
+    header();
+
+#define BENCH_SIZE(STATES, EVENTS) bench<STATES, EVENTS>(count, rounds);
+    DISPATCH_BENCH_SIZES
+#undef BENCH_SIZE
+
+    // keeps the hooks observable
+    return entered == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
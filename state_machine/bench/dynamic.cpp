@@ -0,0 +1,244 @@
+#include "dynamic.h"
+#include "state_machine.h"
+#include "table.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Synthetic machine sizes as BENCH_SIZE(states, events) entries
+#ifndef DYNAMIC_BENCH_SIZES
+#define DYNAMIC_BENCH_SIZES BENCH_SIZE(4, 4) BENCH_SIZE(16, 16) BENCH_SIZE(64, 16)
+#endif
+
+namespace sm = state_machine;
+
+namespace
+{
+
+std::uint64_t entered = 0;
+
+template<std::size_t N>
+constexpr auto digits()
+{
+    if constexpr (N < 10)
+    {
+        return static_string<2>{std::array<const char, 2>{char('0' + N), '\0'}};
+    }
+    else
+    {
+        return digits<N / 10>() + digits<N % 10>();
+    }
+}
+
+// Like dispatch_bench's machine, except that event 0 is guarded: it only
+// moves the machine when its value is odd
+template<std::size_t StateCount, std::size_t EventCount>
+struct synthetic
+{
+    template<std::size_t J>
+    struct event
+    {
+        std::uint32_t value = 0;
+    };
+
+    template<std::size_t I>
+    struct state;
+
+    static constexpr std::size_t target(std::size_t i, std::size_t j)
+    {
+        return (i * 7 + j * 13 + 1) % StateCount;
+    }
+
+    template<std::size_t I, std::size_t... J>
+    static auto handlers(std::index_sequence<J...>)
+      -> sm::will<sm::on<event<J + 1>, sm::transition_to<state<target(I, J + 1)>>>...>;
+
+    template<std::size_t I>
+    using unguarded = decltype(handlers<I>(std::make_index_sequence<EventCount - 1>()));
+
+    template<std::size_t I>
+    struct state : unguarded<I>
+    {
+        using unguarded<I>::handle;
+
+        sm::maybe<sm::transition_to<state<target(I, 0)>>> handle(const event<0>& e)
+        {
+            if (e.value & 1)
+            {
+                return sm::transition_to<state<target(I, 0)>>{};
+            }
+            return sm::nothing{};
+        }
+
+        template<typename Event>
+        void on_enter(const Event&)
+        {
+            ++entered;
+        }
+    };
+
+    template<std::size_t I>
+    friend constexpr auto stringify(sm::types<state<I>>)
+    {
+        return static_string{"s"} + digits<I>();
+    }
+
+    template<std::size_t J>
+    friend constexpr auto stringify(sm::types<event<J>>)
+    {
+        return static_string{"e"} + digits<J>();
+    }
+
+    template<std::size_t... I>
+    static auto states_of(std::index_sequence<I...>) -> sm::types<state<I>...>;
+
+    template<std::size_t... J>
+    static auto events_of(std::index_sequence<J...>) -> sm::types<event<J>...>;
+
+    using states = decltype(states_of(std::make_index_sequence<StateCount>()));
+    using events = decltype(events_of(std::make_index_sequence<EventCount>()));
+
+    template<std::size_t... J>
+    static auto any_event_of(std::index_sequence<J...>) -> std::variant<event<J>...>;
+
+    using any_event = decltype(any_event_of(std::make_index_sequence<EventCount>()));
+
+    template<typename Policy, std::size_t... I>
+    static auto machine_of(std::index_sequence<I...>) -> sm::basic_state_machine<Policy, state<I>...>;
+
+    template<typename Policy>
+    using machine = decltype(machine_of<Policy>(std::make_index_sequence<StateCount>()));
+
+    template<std::size_t... J>
+    static any_event make(std::size_t code, std::uint32_t value, std::index_sequence<J...>)
+    {
+        any_event result;
+        ((code == J && (result = event<J>{value}, true)) || ...);
+        return result;
+    }
+};
+
+struct table_policy : sm::default_policy
+{
+    using dispatch = sm::table_dispatch<0>;
+};
+
+void report(std::size_t states, std::size_t events, const char* path, double seconds, double count)
+{
+    std::cout << std::setw(6) << states << std::setw(7) << events << std::setw(9) << path
+              << std::fixed << std::setprecision(2) << std::setw(10) << seconds * 1e9 / count
+              << std::endl;
+}
+
+template<std::size_t StateCount, std::size_t EventCount>
+bool bench(std::size_t count, unsigned rounds)
+{
+    using machine_type = synthetic<StateCount, EventCount>;
+    using any_event    = typename machine_type::any_event;
+
+    // The runtime table is read from the compiled machine's own printout
+    constexpr auto text = sm::generate_transition_table(typename machine_type::states{},
+                                                        typename machine_type::events{});
+    auto table = sm::dynamic_table::parse(text.data());
+    if (!table)
+    {
+        std::cout << "cannot parse the " << StateCount << "x" << EventCount << " table"
+                  << std::endl;
+        return false;
+    }
+
+    std::uint64_t dynamicEntered = 0;
+    auto countEntry = [](void* context, sm::dynamic_machine&, const sm::dynamic_event&) {
+        ++*static_cast<std::uint64_t*>(context);
+    };
+    auto oddValue = [](void*, const sm::dynamic_machine&, const sm::dynamic_event& e) {
+        return (*static_cast<const std::uint32_t*>(e.payload) & 1) != 0;
+    };
+    for (std::size_t s = 0; s < table->state_count(); ++s)
+    {
+        const auto& name = table->state_name(static_cast<std::uint16_t>(s));
+        table->on_enter(name, countEntry, &dynamicEntered);
+        table->guard(name, table->event_name(0), oddValue);
+    }
+    if (!table->bound())
+    {
+        return false;
+    }
+
+    std::vector<any_event>         stream;
+    std::vector<sm::dynamic_event> dynamicStream;
+    std::vector<std::uint32_t>     values(count);
+    std::uint64_t                  x = 88172645463325252ull;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        const std::size_t code = x % EventCount;
+        values[i]              = static_cast<std::uint32_t>(x >> 32);
+        stream.push_back(
+          machine_type::make(code, values[i], std::make_index_sequence<EventCount>()));
+        dynamicStream.push_back({static_cast<std::uint16_t>(code), &values[i]});
+    }
+
+    auto compiled = [&](auto machine, const char* path) {
+        entered           = 0;
+        auto passToMachine = [&machine](const auto& e) { machine.handle(e); };
+
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned r = 0; r < rounds; ++r)
+        {
+            for (const auto& e : stream)
+            {
+                std::visit(passToMachine, e);
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        report(StateCount, EventCount, path, elapsed.count(), double(count) * rounds);
+        return entered;
+    };
+
+    const std::uint64_t visited =
+      compiled(typename machine_type::template machine<sm::default_policy>{}, "visit");
+    const std::uint64_t tabled =
+      compiled(typename machine_type::template machine<table_policy>{}, "table");
+
+    sm::dynamic_machine machine{*table};
+    const auto          start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        machine.handle_batch(dynamicStream.data(), dynamicStream.data() + dynamicStream.size());
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report(StateCount, EventCount, "dynamic", elapsed.count(), double(count) * rounds);
+
+    // All three must have taken the same transitions
+    return visited == tabled && visited == dynamicEntered;
+}
+
+} // namespace
+
+// Usage: dynamic_bench [events] [rounds]
+int main(int argc, char** argv)
+{
+    const std::size_t count  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+    const unsigned    rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+
+    std::cout << std::setw(6) << "states" << std::setw(7) << "events" << std::setw(9) << "path"
+              << std::setw(10) << "ns/event" << std::endl;
+
+    bool ok = true;
+#define BENCH_SIZE(STATES, EVENTS) ok = bench<STATES, EVENTS>(count, rounds) && ok;
+    DYNAMIC_BENCH_SIZES
+#undef BENCH_SIZE
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
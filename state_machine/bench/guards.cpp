@@ -0,0 +1,186 @@
+#include "perf_counters.h"
+#include "state_machine.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace sm = state_machine;
+
+namespace
+{
+
+struct Step
+{
+    std::uint32_t value;
+};
+
+struct Check
+{
+    std::uint32_t value;
+};
+
+// Ring of guarded states: Step moves forward, backward or nowhere depending
+// on its payload, Check only passes on some values. Handlers are kept out
+// of line, as guard logic of any size is, so their action crosses a call
+// boundary instead of being folded into the dispatch. With Stateless, the
+// actions are plain transitions and one_of keeps an index; otherwise they
+// carry a (unused) byte, which keeps one_of on its variant path.
+template<bool Stateless>
+struct guarded
+{
+    static constexpr std::size_t count = 4;
+
+    template<std::size_t I>
+    struct state;
+
+    template<typename Target>
+    struct stateful : sm::transition_to<Target>
+    {
+        std::uint8_t unused = 0;
+    };
+
+    template<std::size_t I>
+    using go = std::conditional_t<Stateless,
+                                  sm::transition_to<state<I % count>>,
+                                  stateful<state<I % count>>>;
+
+    template<std::size_t I>
+    struct state
+    {
+        [[gnu::noinline]] sm::one_of<go<I + 1>, go<I + count - 1>, sm::nothing> handle(const Step& e)
+        {
+            switch (e.value % 3)
+            {
+                case 0:
+                    return go<I + 1>{};
+                case 1:
+                    return go<I + count - 1>{};
+                default:
+                    return sm::nothing{};
+            }
+        }
+
+        [[gnu::noinline]] sm::maybe<go<I + 2>> handle(const Check& e)
+        {
+            if (e.value & 1)
+            {
+                return go<I + 2>{};
+            }
+            return sm::nothing{};
+        }
+
+        template<typename Event>
+        void on_enter(const Event&)
+        {
+            ++entered;
+        }
+
+        std::uint64_t entered = 0;
+    };
+
+    using machine = sm::state_machine<state<0>, state<1>, state<2>, state<3>>;
+};
+
+using event = std::variant<Step, Check>;
+
+std::vector<event> make_stream(std::size_t count)
+{
+    std::vector<event> stream;
+    stream.reserve(count);
+    std::uint64_t x = 88172645463325252ull;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        // Most guards see the common value, as in steady traffic
+        const auto value = static_cast<std::uint32_t>(x % 10 == 0 ? x >> 8 : 1);
+        stream.push_back(x & 1 ? event{Step{value}} : event{Check{value}});
+    }
+    return stream;
+}
+
+struct result
+{
+    double seconds = 0;
+    double events  = 0;
+
+    perf_counters::sample sample;
+};
+
+template<bool Stateless>
+result run(const std::vector<event>& stream, unsigned rounds)
+{
+    using machine = typename guarded<Stateless>::machine;
+
+    machine       m;
+    perf_counters perf;
+    auto          passToMachine = [&m](const auto& e) { m.handle(e); };
+
+    const auto start = std::chrono::steady_clock::now();
+    perf.start();
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        for (const auto& e : stream)
+        {
+            std::visit(passToMachine, e);
+        }
+    }
+    const auto sample  = perf.stop();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    return {elapsed.count(), double(stream.size()) * rounds, sample};
+}
+
+void report(const char* path, const result& best, bool counted)
+{
+    std::cout << std::setw(8) << path << std::fixed << std::setprecision(2) << std::setw(10)
+              << best.seconds * 1e9 / best.events;
+    if (counted)
+    {
+        std::cout << std::setw(11) << best.sample.instructions / best.events << std::setw(12)
+                  << best.sample.branch_misses / best.events;
+    }
+    else
+    {
+        std::cout << std::setw(11) << "-" << std::setw(12) << "-";
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+// Usage: guards_bench [events] [rounds]
+//
+// Compares one_of/maybe handlers whose actions are stateless (index path)
+// with the same machine whose actions carry state (variant path).
+int main(int argc, char** argv)
+{
+    const std::size_t count  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+    const unsigned    rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+
+    static_assert(sizeof(sm::maybe<sm::transition_to<Step>>) == 1);
+
+    const auto stream  = make_stream(count);
+    const bool counted = perf_counters{}.available();
+
+    // Best of alternating repetitions, so both paths see the same machine
+    // conditions
+    result variant, index;
+    for (int repetition = 0; repetition < 5; ++repetition)
+    {
+        const result v = run<false>(stream, rounds);
+        const result i = run<true>(stream, rounds);
+        variant        = repetition == 0 || v.seconds < variant.seconds ? v : variant;
+        index          = repetition == 0 || i.seconds < index.seconds ? i : index;
+    }
+
+    std::cout << std::setw(8) << "path" << std::setw(10) << "ns/event" << std::setw(11)
+              << "instr/ev" << std::setw(12) << "bmiss/ev" << std::endl;
+    report("variant", variant, counted);
+    report("index", index, counted);
+    return EXIT_SUCCESS;
+}
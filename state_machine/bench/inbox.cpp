@@ -0,0 +1,121 @@
+#include "inbox.h"
+#include "state_machine.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace sm = state_machine;
+
+namespace
+{
+
+struct Tick
+{
+    std::uint32_t producer;
+    std::uint32_t seq;
+};
+
+struct Stats
+{
+    std::vector<std::uint32_t> next;
+    std::uint64_t              handled  = 0;
+    std::uint64_t              reorders = 0;
+};
+
+Stats* stats = nullptr;
+
+void record(const Tick& tick)
+{
+    ++stats->handled;
+    if (tick.seq != stats->next[tick.producer]++)
+    {
+        ++stats->reorders;
+    }
+}
+
+struct Even;
+struct Odd;
+
+struct Even : sm::will<sm::on<Tick, sm::transition_to<Odd>>>
+{
+    void on_enter(const Tick& tick)
+    {
+        record(tick);
+    }
+};
+
+struct Odd : sm::will<sm::on<Tick, sm::transition_to<Even>>>
+{
+    void on_enter(const Tick& tick)
+    {
+        record(tick);
+    }
+};
+
+using Machine = sm::state_machine<Even, Odd>;
+
+bool run(std::uint32_t producers, std::uint32_t perProducer, std::size_t capacity)
+{
+    Stats local;
+    local.next.assign(producers, 0);
+    stats = &local;
+
+    Machine                  machine;
+    sm::inbox<Machine, Tick> inbox{machine, capacity};
+    std::atomic<bool>        stop{false};
+    std::vector<std::thread> threads;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint32_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&inbox, p, perProducer] {
+            for (std::uint32_t seq = 0; seq < perProducer; ++seq)
+            {
+                inbox.post_wait(Tick{p, seq});
+            }
+        });
+    }
+
+    std::thread joiner([&threads, &stop] {
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        stop.store(true, std::memory_order_release);
+    });
+
+    inbox.run(stop);
+    joiner.join();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    const std::uint64_t expected = std::uint64_t{producers} * perProducer;
+    const bool          ok       = local.handled == expected && local.reorders == 0;
+
+    std::cout << "producers: " << producers << "  events: " << local.handled << "/" << expected
+              << "  Mevents/s: " << local.handled / elapsed.count() / 1e6
+              << "  full: " << inbox.overflows() << "  reordered: " << local.reorders
+              << (ok ? "" : "  FAILED") << std::endl;
+
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::uint32_t total    = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 21;
+    const std::size_t   capacity = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+    bool                ok       = true;
+
+    for (std::uint32_t producers : {1, 2, 4, 8, 16})
+    {
+        ok = run(producers, total / producers, capacity) && ok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
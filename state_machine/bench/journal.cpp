@@ -0,0 +1,141 @@
+#include "journal.h"
+#include "state_machine.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace sm = state_machine;
+
+namespace
+{
+
+struct Open
+{
+};
+
+struct Close
+{
+};
+
+struct Lock
+{
+    std::uint32_t key;
+};
+
+struct Unlock
+{
+    std::uint32_t key;
+};
+
+struct Opened;
+struct Locked;
+
+struct Closed : sm::will<sm::by_default<sm::nothing>,
+                         sm::on<Lock, sm::transition_to<Locked, sm::from_event<Locked>>>,
+                         sm::on<Open, sm::transition_to<Opened>>>
+{
+};
+
+struct Opened : sm::will<sm::by_default<sm::nothing>, sm::on<Close, sm::transition_to<Closed>>>
+{
+};
+
+struct Locked : sm::by_default<sm::nothing>
+{
+    using sm::by_default<sm::nothing>::handle;
+
+    Locked() = default;
+
+    Locked(const Lock& e)
+      : key(e.key)
+    {
+    }
+
+    sm::maybe<sm::transition_to<Closed>> handle(const Unlock& e)
+    {
+        if (e.key == key)
+        {
+            return sm::transition_to<Closed>{};
+        }
+        return sm::nothing{};
+    }
+
+    std::uint32_t key = 0;
+};
+
+using machine = sm::state_machine<Closed, Opened, Locked>;
+
+double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+// Usage: journal_bench [file] [events] [events per commit]
+int main(int argc, char** argv)
+{
+    const std::string path     = argc > 1 ? argv[1] : "journal_bench.smjl";
+    const std::size_t count    = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000;
+    const std::size_t perCommit = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 65536;
+
+    std::remove(path.c_str());
+
+    machine live;
+    auto    start = std::chrono::steady_clock::now();
+    {
+        sm::journal_writer<Open, Close, Lock, Unlock> journal{path.c_str()};
+        sm::journaled<machine, Open, Close, Lock, Unlock> driver{live, journal};
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const auto key = static_cast<std::uint32_t>(i >> 2);
+            switch (i & 3)
+            {
+                case 0:
+                    driver.handle(Lock{key});
+                    break;
+                case 1:
+                    driver.handle(Unlock{key});
+                    break;
+                case 2:
+                    driver.handle(Open{});
+                    break;
+                default:
+                    driver.handle(Close{});
+                    break;
+            }
+            if ((i + 1) % perCommit == 0)
+            {
+                journal.commit();
+            }
+        }
+        if (!journal.commit())
+        {
+            std::cerr << "journal write failed" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    const double written = since(start);
+
+    machine replayed;
+    start             = std::chrono::steady_clock::now();
+    const auto result = sm::replay_journal<Open, Close, Lock, Unlock>(path.c_str(), replayed);
+    const double read = since(start);
+
+    std::remove(path.c_str());
+
+    const double megabytes = (16 + count * 3.0) / 1e6;
+    std::cout << std::fixed << std::setprecision(2) << "events " << count << ", " << megabytes
+              << " MB, commit every " << perCommit << '\n'
+              << "write + commit: " << std::setw(8) << count / written / 1e6 << " Mevents/s "
+              << std::setw(8) << megabytes / written << " MB/s\n"
+              << "replay:         " << std::setw(8) << count / read / 1e6 << " Mevents/s "
+              << std::setw(8) << megabytes / read << " MB/s" << std::endl;
+
+    return result.complete && result.events == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,108 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware instruction and branch-miss counters of the calling thread.
+// Where perf events are unavailable (other systems, or a restrictive
+// perf_event_paranoid) available() is false and the counts stay zero.
+class perf_counters
+{
+  public:
+    struct sample
+    {
+        std::uint64_t instructions  = 0;
+        std::uint64_t branch_misses = 0;
+    };
+
+    perf_counters()
+    {
+#ifdef __linux__
+        instructions  = open(PERF_COUNT_HW_INSTRUCTIONS);
+        branch_misses = open(PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    ~perf_counters()
+    {
+#ifdef __linux__
+        if (instructions >= 0)
+        {
+            close(instructions);
+        }
+        if (branch_misses >= 0)
+        {
+            close(branch_misses);
+        }
+#endif
+    }
+
+    bool available() const
+    {
+        return instructions >= 0 && branch_misses >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (available())
+        {
+            ioctl(instructions, PERF_EVENT_IOC_RESET, 0);
+            ioctl(branch_misses, PERF_EVENT_IOC_RESET, 0);
+            ioctl(instructions, PERF_EVENT_IOC_ENABLE, 0);
+            ioctl(branch_misses, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    sample stop()
+    {
+        sample result;
+#ifdef __linux__
+        if (available())
+        {
+            ioctl(instructions, PERF_EVENT_IOC_DISABLE, 0);
+            ioctl(branch_misses, PERF_EVENT_IOC_DISABLE, 0);
+            result.instructions  = read_counter(instructions);
+            result.branch_misses = read_counter(branch_misses);
+        }
+#endif
+        return result;
+    }
+
+  private:
+#ifdef __linux__
+    static int open(std::uint64_t config)
+    {
+        perf_event_attr attr{};
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    static std::uint64_t read_counter(int fd)
+    {
+        std::uint64_t value = 0;
+        return ::read(fd, &value, sizeof(value)) == sizeof(value) ? value : 0;
+    }
+#endif
+
+    int instructions  = -1;
+    int branch_misses = -1;
+};
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,144 @@
+#include "sharded.h"
+#include "state_machine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace sm = state_machine;
+
+namespace
+{
+
+struct Tick
+{
+    std::uint32_t value;
+};
+
+struct Even;
+struct Odd;
+
+struct Even : sm::will<sm::on<Tick, sm::transition_to<Odd>>>
+{
+    void on_enter(const Tick& tick)
+    {
+        sum += tick.value;
+    }
+
+    std::uint64_t sum = 0;
+};
+
+struct Odd : sm::will<sm::on<Tick, sm::transition_to<Even>>>
+{
+    void on_enter(const Tick& tick)
+    {
+        sum += tick.value;
+    }
+
+    std::uint64_t sum = 0;
+};
+
+using machine = sm::state_machine<Even, Odd>;
+using runtime = sm::sharded_runtime<machine, Tick>;
+
+struct result
+{
+    double      seconds = 0;
+    sm::shard_stats total;
+};
+
+// Every shard produces perShard ticks for uniformly random instances, a
+// chunk per call, as if reading them off its own network queue
+result run(unsigned shards, std::size_t instances, std::size_t perShard, bool print)
+{
+    runtime::options config;
+    config.shards   = shards;
+    config.capacity = 8192;
+    runtime fleet{instances, [](std::size_t) { return machine{}; }, config};
+
+    // Copied into every worker, so the counters are per shard
+    auto source = [instances, perShard, done = std::size_t{0}, x = std::uint64_t{0}](
+                    runtime::shard& self) mutable {
+        if (done == 0)
+        {
+            x = 88172645463325252ull ^ (self.index() + 1) * 0x9e3779b97f4a7c15ull;
+        }
+        const std::size_t last = std::min<std::size_t>(done + 256, perShard);
+        for (; done < last; ++done)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            self.post(x % instances, Tick{static_cast<std::uint32_t>(x)});
+        }
+        return done < perShard;
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    fleet.start(source);
+    fleet.stop();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    result r{elapsed.count(), {}};
+    for (unsigned i = 0; i < shards; ++i)
+    {
+        const auto s = fleet.stats(i);
+        if (print)
+        {
+            std::cout << "  shard " << std::setw(3) << i << std::setw(12) << s.events << " events"
+                      << std::setw(12) << s.remote << " remote" << std::setw(9) << std::fixed
+                      << std::setprecision(1) << (s.batches ? double(s.remote) / s.batches : 0.0)
+                      << " per batch" << std::setw(8) << s.stalls << " stalls" << std::endl;
+        }
+        r.total.events += s.events;
+        r.total.remote += s.remote;
+        r.total.stalls += s.stalls;
+    }
+    return r;
+}
+
+} // namespace
+
+// Usage: sharded_bench [instances] [events per shard] [max shards]
+//
+// Weak scaling: every shard adds the same load, so throughput should grow
+// with the shard count up to the number of cores.
+int main(int argc, char** argv)
+{
+    const std::size_t instances = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+    const std::size_t perShard  = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1 << 22;
+    const unsigned    cores     = std::max(1u, std::thread::hardware_concurrency());
+    const unsigned    maxShards = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : cores;
+
+    std::vector<unsigned> counts;
+    for (unsigned shards = 1; shards < maxShards; shards *= 2)
+    {
+        counts.push_back(shards);
+    }
+    counts.push_back(maxShards);
+
+    std::cout << std::setw(7) << "shards" << std::setw(14) << "Mevents/s" << std::setw(10)
+              << "speedup" << std::setw(12) << "efficiency" << std::endl;
+
+    bool   ok   = true;
+    double base = 0;
+    for (unsigned shards : counts)
+    {
+        const result r    = run(shards, instances, perShard, false);
+        const double rate = r.total.events / r.seconds;
+        base              = base == 0 ? rate : base;
+        ok                = ok && r.total.events == perShard * shards;
+        std::cout << std::setw(7) << shards << std::fixed << std::setprecision(2) << std::setw(14)
+                  << rate / 1e6 << std::setw(10) << rate / base << std::setw(11)
+                  << 100 * rate / base / shards << "%" << std::endl;
+    }
+
+    std::cout << "per shard at " << maxShards << " shards:" << std::endl;
+    run(maxShards, instances, perShard, true);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
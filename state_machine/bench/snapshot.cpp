@@ -0,0 +1,141 @@
+#include "snapshot.h"
+#include "state_machine.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace sm = state_machine;
+
+namespace
+{
+
+struct Lock
+{
+    std::uint32_t key;
+};
+
+struct Unlock
+{
+    std::uint32_t key;
+};
+
+struct Locked;
+
+struct Closed : sm::will<sm::by_default<sm::nothing>,
+                         sm::on<Lock, sm::transition_to<Locked, sm::from_event<Locked>>>>
+{
+};
+
+struct Locked : sm::by_default<sm::nothing>
+{
+    using sm::by_default<sm::nothing>::handle;
+
+    Locked() = default;
+
+    Locked(const Lock& e)
+      : key(e.key)
+    {
+    }
+
+    sm::maybe<sm::transition_to<Closed>> handle(const Unlock& e)
+    {
+        if (e.key == key)
+        {
+            return sm::transition_to<Closed>{};
+        }
+        return sm::nothing{};
+    }
+
+    std::uint32_t key = 0;
+};
+
+using pool_type = sm::machine_pool<Closed, Locked>;
+using snapshot  = sm::pool_snapshot<Closed, Locked>;
+
+double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Locks every other instance with a key derived from its id, the way a
+// replay of recorded traffic would leave the fleet
+double replay(pool_type& pool)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t id = 0; id < pool.size(); id += 2)
+    {
+        pool.handle(id, Lock{static_cast<std::uint32_t>(id * 2654435761u)});
+    }
+    return since(start);
+}
+
+std::uint64_t checksum(pool_type& pool)
+{
+    std::uint64_t sum = 0;
+    for (std::size_t id = 0; id < pool.size(); ++id)
+    {
+        sum = sum * 31 + pool.current_index(id) + pool.get<Locked>(id).key;
+    }
+    return sum;
+}
+
+bool bench(std::size_t instances, const std::string& path)
+{
+    pool_type    pool{instances, Closed{}, Locked{}};
+    const double replayed = replay(pool);
+    const auto   expected = checksum(pool);
+
+    auto         start = std::chrono::steady_clock::now();
+    const bool   saved = snapshot::save(pool, path.c_str());
+    const double save  = since(start);
+
+    start                 = std::chrono::steady_clock::now();
+    auto         restored = snapshot::restore(path.c_str());
+    const double restore  = since(start);
+
+    start                   = std::chrono::steady_clock::now();
+    const bool   same       = restored && checksum(*restored) == expected;
+    const double firstTouch = since(start);
+
+    std::remove(path.c_str());
+
+    std::cout << std::setw(10) << instances << std::fixed << std::setprecision(2) << std::setw(12)
+              << replayed << std::setw(10) << save << std::setw(12) << restore << std::setw(14)
+              << firstTouch << (saved && same ? "" : "  failed") << std::endl;
+    return saved && same;
+}
+
+} // namespace
+
+// Usage: snapshot_bench [file] [instances...]
+int main(int argc, char** argv)
+{
+    const std::string        path = argc > 1 ? argv[1] : "snapshot_bench.smps";
+    std::vector<std::size_t> counts;
+    for (int i = 2; i < argc; ++i)
+    {
+        counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (counts.empty())
+    {
+        counts = {1000000, 10000000};
+    }
+
+    std::cout << std::setw(10) << "instances" << std::setw(12) << "replay ms" << std::setw(10)
+              << "save ms" << std::setw(12) << "restore ms" << std::setw(14) << "first pass ms"
+              << std::endl;
+
+    bool ok = true;
+    for (std::size_t count : counts)
+    {
+        ok = bench(count, path) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,103 @@
+#include "pool.h"
+#include "state_machine.h"
+#include "timer_wheel.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace sm = state_machine;
+
+namespace
+{
+
+struct Lock
+{
+};
+
+struct Unlock
+{
+};
+
+struct Locked;
+
+struct Unlocked : sm::will<sm::by_default<sm::nothing>, sm::on<Lock, sm::transition_to<Locked>>>
+{
+};
+
+struct Locked : sm::will<sm::by_default<sm::nothing>, sm::on<Unlock, sm::transition_to<Unlocked>>>
+{
+};
+
+using pool_type = sm::machine_pool<Unlocked, Locked>;
+using wheel     = sm::timer_wheel<sm::virtual_clock, Lock, Unlock>;
+
+double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+// Usage: timers_bench [instances]
+//
+// Every instance gets an auto-relock timer 1..3600 s ahead on a 1 ms wheel;
+// every other timer is cancelled again, and the virtual clock then runs one
+// simulated hour in 100 ms steps, delivering expired timers to the pool.
+int main(int argc, char** argv)
+{
+    const std::size_t instances = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    sm::virtual_clock clock;
+    wheel             timers{clock, std::chrono::milliseconds(1)};
+    pool_type         pool{instances};
+
+    std::vector<sm::timer_id> ids(instances);
+    std::uint64_t             x = 88172645463325252ull;
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t id = 0; id < instances; ++id)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        ids[id] = timers.schedule(id, std::chrono::milliseconds(1000 + x % 3599000), Lock{});
+    }
+    const double scheduled = since(start) / instances;
+
+    start = std::chrono::steady_clock::now();
+    for (std::size_t id = 0; id < instances; id += 2)
+    {
+        timers.cancel(ids[id]);
+    }
+    const double cancelled = since(start) / ((instances + 1) / 2);
+
+    std::size_t fired = 0;
+    start             = std::chrono::steady_clock::now();
+    for (int step = 0; step < 36000; ++step)
+    {
+        clock.advance(std::chrono::milliseconds(100));
+        fired += timers.poll([&pool](const auto* first, const auto* last) {
+            pool.handle_batch(first, last, 1);
+        });
+    }
+    const double polled = since(start);
+
+    std::size_t locked = 0;
+    for (std::size_t id = 0; id < instances; ++id)
+    {
+        locked += pool.current_index(id);
+    }
+
+    std::cout << std::fixed << std::setprecision(1) << "instances " << instances << '\n'
+              << "schedule  " << std::setw(8) << scheduled << " ns/timer\n"
+              << "cancel    " << std::setw(8) << cancelled << " ns/timer\n"
+              << "poll      " << std::setw(8) << polled / std::max<std::size_t>(fired, 1)
+              << " ns/fired timer, " << fired << " fired over 36000 polls" << std::endl;
+
+    return fired == instances / 2 && locked == fired ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,386 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include "pool.h"
+#include "state_machine.h"
+#include "types/resolve.h"
+#include "types/types.h"
+#include "types/util.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__) || (defined(__AVX512BW__) && defined(__AVX512VBMI__))
+#include <immintrin.h>
+#endif
+
+namespace state_machine
+{
+
+// Set in a step table entry when the pair's action is a transition, which
+// runs the hooks even when it leads back into the same state
+constexpr std::uint8_t fired_bit = 0x80;
+
+// Next state of every (state, event) pair of a payload-free machine, as
+// entries[event << shift | state]. States are padded to a power of two so
+// the pair's entry is found with a shift and an or, in scalar and in SIMD
+// lanes alike. The array is padded for whole-vector loads and 4-byte
+// gathers.
+template<std::size_t StateCount, std::size_t EventCount>
+struct step_table
+{
+    static constexpr unsigned shift = [] {
+        unsigned bits = 0;
+        while ((std::size_t{1} << bits) < StateCount)
+        {
+            ++bits;
+        }
+        return bits;
+    }();
+    static constexpr std::size_t size = EventCount << shift;
+
+    std::array<std::uint8_t, std::max<std::size_t>(size + 3, 128)> entries{};
+};
+
+namespace detail
+{
+
+template<typename Action>
+struct plain_transition : std::false_type
+{
+};
+
+template<typename State>
+struct plain_transition<transition_to<State>> : std::true_type
+{
+    using target = entry_state_t<State>;
+};
+
+template<typename State, typename Event>
+using step_action = type_of_t<decltype(resolve_action{}(types<State, Event>{}))>;
+
+template<typename Action, typename... States>
+constexpr std::uint8_t step_entry(std::size_t self, types<States...>)
+{
+    if constexpr (std::is_same_v<Action, nothing>)
+    {
+        return static_cast<std::uint8_t>(self);
+    }
+    else
+    {
+        static_assert(plain_transition<Action>::value,
+                      "bulk stepping needs actions that depend only on (state, event): "
+                      "nothing or transition_to without a factory");
+        using Target                 = typename plain_transition<Action>::target;
+        constexpr std::size_t target = index_of<Target>(types<States...>{});
+        static_assert(target < sizeof...(States), "transition to a state outside the machine");
+        return static_cast<std::uint8_t>(target | fired_bit);
+    }
+}
+
+template<typename Table, typename... States, typename Event>
+constexpr void fill_step_column(Table& table, std::size_t event, types<States...> states, types<Event>)
+{
+    std::size_t state = 0;
+    ((table.entries[event << Table::shift | state] =
+        step_entry<step_action<States, Event>>(state, states),
+      ++state),
+     ...);
+}
+
+inline std::size_t popcount(std::uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(bits);
+#else
+    std::size_t count = 0;
+    for (; bits != 0; bits &= bits - 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+#if defined(__AVX512BW__) && defined(__AVX512VBMI__)
+
+// Tables of up to 128 entries: one or two byte permutes step 64 instances
+template<std::size_t S, std::size_t E>
+std::size_t step_avx512(const step_table<S, E>& table,
+                        std::uint8_t*            states,
+                        const std::uint8_t*      events,
+                        std::size_t              blocks,
+                        std::uint64_t*           fired)
+{
+    using table_type = step_table<S, E>;
+
+    const __m512i lo        = _mm512_loadu_si512(table.entries.data());
+    const __m512i hi        = _mm512_loadu_si512(table.entries.data() + 64);
+    const __m512i eventMask = _mm512_set1_epi8(static_cast<char>(0xff << table_type::shift));
+    const __m512i stateMask = _mm512_set1_epi8(static_cast<char>(~fired_bit));
+
+    std::size_t total = 0;
+    for (std::size_t block = 0; block < blocks; ++block, states += 64, events += 64)
+    {
+        const __m512i s     = _mm512_loadu_si512(states);
+        const __m512i e     = _mm512_loadu_si512(events);
+        const __m512i index = _mm512_or_si512(
+          _mm512_and_si512(_mm512_slli_epi16(e, table_type::shift), eventMask), s);
+
+        __m512i entry;
+        if constexpr (table_type::size <= 64)
+        {
+            entry = _mm512_permutexvar_epi8(index, lo);
+        }
+        else
+        {
+            entry = _mm512_permutex2var_epi8(lo, index, hi);
+        }
+
+        const std::uint64_t mask = _mm512_movepi8_mask(entry);
+        _mm512_storeu_si512(states, _mm512_and_si512(entry, stateMask));
+        total += popcount(mask);
+        if (fired != nullptr)
+        {
+            fired[block] = mask;
+        }
+    }
+    return total;
+}
+
+#endif
+
+#if defined(__AVX2__)
+
+// Tables of up to 64 entries: each 16-entry piece is looked up with a byte
+// shuffle and the pieces are blended by the high bits of the pair index
+template<std::size_t S, std::size_t E>
+std::uint32_t shuffle_half(const step_table<S, E>& table,
+                           std::uint8_t*            states,
+                           const std::uint8_t*      events)
+{
+    using table_type = step_table<S, E>;
+
+    constexpr std::size_t pieces    = (table_type::size + 15) / 16;
+    const __m256i         eventMask = _mm256_set1_epi8(static_cast<char>(0xff << table_type::shift));
+    const __m256i         lowMask   = _mm256_set1_epi8(0x0f);
+
+    const __m256i s     = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(states));
+    const __m256i e     = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(events));
+    const __m256i index = _mm256_or_si256(
+      _mm256_and_si256(_mm256_slli_epi16(e, table_type::shift), eventMask), s);
+    const __m256i low   = _mm256_and_si256(index, lowMask);
+    const __m256i piece = _mm256_and_si256(_mm256_srli_epi16(index, 4), lowMask);
+
+    __m256i entry = _mm256_shuffle_epi8(
+      _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.entries.data()))),
+      low);
+    for (std::size_t k = 1; k < pieces; ++k)
+    {
+        const __m256i row = _mm256_broadcastsi128_si256(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.entries.data() + 16 * k)));
+        entry = _mm256_blendv_epi8(entry,
+                                   _mm256_shuffle_epi8(row, low),
+                                   _mm256_cmpeq_epi8(piece, _mm256_set1_epi8(static_cast<char>(k))));
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(states),
+                        _mm256_and_si256(entry, _mm256_set1_epi8(static_cast<char>(~fired_bit))));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(entry));
+}
+
+// Larger tables: 32-bit gathers of the entries of 8 instances at a time,
+// four of them packed back into 32 state bytes
+template<std::size_t S, std::size_t E>
+std::uint32_t gather_half(const step_table<S, E>& table,
+                          std::uint8_t*            states,
+                          const std::uint8_t*      events)
+{
+    using table_type = step_table<S, E>;
+
+    const int* base = reinterpret_cast<const int*>(table.entries.data());
+    __m256i    gathered[4];
+    for (std::size_t k = 0; k < 4; ++k)
+    {
+        const __m256i s = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(states + 8 * k)));
+        const __m256i e = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(events + 8 * k)));
+        const __m256i index = _mm256_or_si256(_mm256_slli_epi32(e, table_type::shift), s);
+        gathered[k] = _mm256_and_si256(_mm256_i32gather_epi32(base, index, 1), _mm256_set1_epi32(0xff));
+    }
+
+    const __m256i words = _mm256_packus_epi16(_mm256_packus_epi32(gathered[0], gathered[1]),
+                                              _mm256_packus_epi32(gathered[2], gathered[3]));
+    const __m256i entry =
+      _mm256_permutevar8x32_epi32(words, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(states),
+                        _mm256_and_si256(entry, _mm256_set1_epi8(static_cast<char>(~fired_bit))));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(entry));
+}
+
+template<std::size_t S, std::size_t E>
+std::size_t step_avx2(const step_table<S, E>& table,
+                      std::uint8_t*            states,
+                      const std::uint8_t*      events,
+                      std::size_t              blocks,
+                      std::uint64_t*           fired)
+{
+    std::size_t total = 0;
+    for (std::size_t block = 0; block < blocks; ++block, states += 64, events += 64)
+    {
+        std::uint64_t mask;
+        if constexpr (step_table<S, E>::size <= 64)
+        {
+            mask = shuffle_half(table, states, events)
+                   | std::uint64_t{shuffle_half(table, states + 32, events + 32)} << 32;
+        }
+        else
+        {
+            mask = gather_half(table, states, events)
+                   | std::uint64_t{gather_half(table, states + 32, events + 32)} << 32;
+        }
+        total += popcount(mask);
+        if (fired != nullptr)
+        {
+            fired[block] = mask;
+        }
+    }
+    return total;
+}
+
+#endif
+
+} // namespace detail
+
+// Extracts the step table of a machine whose states carry no data and whose
+// actions are nothing or transition_to without a factory, so that each step
+// is a pure lookup
+template<typename... States, typename... Events>
+constexpr auto make_step_table(types<States...> states, types<Events...>)
+{
+    static_assert(sizeof...(States) <= 128, "state index and fired bit must fit in a byte");
+    static_assert(sizeof...(Events) <= 256, "event index must fit in a byte");
+    static_assert((std::is_empty_v<States> && ...), "bulk stepping is for states without data");
+
+    step_table<sizeof...(States), sizeof...(Events)> table{};
+    std::size_t                                      event = 0;
+    (detail::fill_step_column(table, event++, states, types<Events>{}), ...);
+    return table;
+}
+
+// Steps instance i from states[i] by the event with index events[i], one
+// instance after the other. Returns how many transitions fired; fired, if
+// given, receives one bit per instance (bit i % 64 of word i / 64).
+// Indices are not checked: every events[i] must be below E and every
+// states[i] below S, or the lookup reads past the table.
+template<std::size_t S, std::size_t E>
+std::size_t step_bulk_scalar(const step_table<S, E>& table,
+                             std::uint8_t*            states,
+                             const std::uint8_t*      events,
+                             std::size_t              count,
+                             std::uint64_t*           fired = nullptr)
+{
+    constexpr unsigned shift = step_table<S, E>::shift;
+
+    std::size_t total = 0;
+    for (std::size_t first = 0; first < count; first += 64)
+    {
+        const std::size_t last = std::min(first + 64, count);
+        std::uint64_t     mask = 0;
+        for (std::size_t i = first; i < last; ++i)
+        {
+            const std::uint8_t entry = table.entries[std::size_t{events[i]} << shift | states[i]];
+            states[i]                = entry & ~fired_bit;
+            mask |= std::uint64_t(entry >> 7) << (i - first);
+        }
+        total += detail::popcount(mask);
+        if (fired != nullptr)
+        {
+            fired[first / 64] = mask;
+        }
+    }
+    return total;
+}
+
+// As step_bulk_scalar, 64 instances at a time with the widest lookup the
+// build targets: AVX-512 VBMI byte permutes for tables of up to 128
+// entries, AVX2 byte shuffles up to 64 entries and gathers beyond. The
+// last count % 64 instances, and builds without these extensions, take the
+// scalar path, so events[i] < E is required on every path.
+template<std::size_t S, std::size_t E>
+std::size_t step_bulk(const step_table<S, E>& table,
+                      std::uint8_t*            states,
+                      const std::uint8_t*      events,
+                      std::size_t              count,
+                      std::uint64_t*           fired = nullptr)
+{
+    std::size_t done  = 0;
+    std::size_t total = 0;
+
+#if defined(__AVX512BW__) && defined(__AVX512VBMI__)
+    if constexpr (step_table<S, E>::size <= 128)
+    {
+        total = detail::step_avx512(table, states, events, count / 64, fired);
+        done  = count / 64 * 64;
+    }
+    else
+#endif
+    {
+#if defined(__AVX2__)
+        total = detail::step_avx2(table, states, events, count / 64, fired);
+        done  = count / 64 * 64;
+#endif
+    }
+
+    return total
+           + step_bulk_scalar(table,
+                              states + done,
+                              events + done,
+                              count - done,
+                              fired != nullptr ? fired + done / 64 : nullptr);
+}
+
+// Steps every instance of a payload-free pool by one event: events[id] is
+// the index in Events of the event instance id receives, and must be below
+// sizeof...(Events). Hooks and actions do not run; fired tells which
+// instances took a transition.
+template<typename... Events, typename... States>
+std::size_t step_pool(machine_pool<States...>& pool,
+                      const std::uint8_t*      events,
+                      std::uint64_t*           fired = nullptr)
+{
+    static constexpr auto table = make_step_table(types<States...>{}, types<Events...>{});
+    return step_bulk(table, pool.state_indices(), events, pool.size(), fired);
+}
+
+// Calls f(id) for every instance whose bit is set in a fired bitmap
+template<typename F>
+void for_each_fired(const std::uint64_t* fired, std::size_t count, F&& f)
+{
+    for (std::size_t word = 0; word < (count + 63) / 64; ++word)
+    {
+        for (std::uint64_t bits = fired[word]; bits != 0; bits &= bits - 1)
+        {
+#if defined(__GNUC__)
+            f(word * 64 + __builtin_ctzll(bits));
+#else
+            std::size_t bit = 0;
+            while ((bits >> bit & 1) == 0)
+            {
+                ++bit;
+            }
+            f(word * 64 + bit);
+#endif
+        }
+    }
+}
+
+} // namespace state_machine
+
+#endif // BULK_H
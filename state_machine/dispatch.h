@@ -0,0 +1,158 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include "types/resolve.h"
+#include "types/types.h"
+#include "types/util.h"
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace state_machine
+{
+
+struct nothing;
+
+// Dispatches through std::visit over the current state
+struct visit_dispatch
+{
+    template<typename Self, typename Machine, typename Event>
+    static void handle(Self& self, Machine& machine, const Event& event)
+    {
+        auto passEventToState = [&self, &machine, &event](auto& state) {
+            self.pass(state, machine, event);
+        };
+
+        self.storage.visit(passEventToState);
+    }
+
+    // Passes the event to a state already looked up, as handle_batch does
+    template<typename Self, typename State, typename Machine, typename Event>
+    static void pass(Self& self, State& state, Machine& machine, const Event& event)
+    {
+        self.pass(state, machine, event);
+    }
+};
+
+// Dispatches through a constexpr [state] column of handler thunks generated
+// from (states * types<Event>), one column per event type. Machines with at
+// most SwitchLimit states are dispatched by a chain of index comparisons,
+// which the compiler lowers to a switch instead of an indirect call.
+//
+// Pairs whose action type is nothing are resolved at compile time: their
+// handlers are not called and the table is guarded by an early-out branch.
+// This is part of the contract: a handle overload returning nothing must
+// not have side effects (logging, counters, guards that change the state),
+// since under this policy it never runs, and such pairs do not show up in
+// the profiler's stats either. Handlers that may act return maybe<...> or
+// one_of<...> and are always called.
+template<std::size_t SwitchLimit = 32>
+struct table_dispatch
+{
+    template<typename Self, typename Machine, typename Event>
+    static void handle(Self& self, Machine& machine, const Event& event)
+    {
+        constexpr auto states = Self::get_state_types();
+        constexpr auto ignored = (states * types<Event>{}) | ignored_mask{};
+
+        if constexpr (all_of(ignored))
+        {
+            return;
+        }
+        else if constexpr (size(states) <= SwitchLimit)
+        {
+            by_switch(states,
+                      std::make_index_sequence<size(states)>(),
+                      self,
+                      machine,
+                      event);
+        }
+        else
+        {
+            static constexpr auto table =
+              (states * types<Event>{}) | make_thunks<Self, Machine>{};
+            const std::size_t index = self.storage.index();
+            if (!ignored[index])
+            {
+                table[index](self, machine, event);
+            }
+        }
+    }
+
+    // Passes the event to a state already looked up, as handle_batch does,
+    // skipping the same pairs handle() does
+    template<typename Self, typename State, typename Machine, typename Event>
+    static void pass(Self& self, State& state, Machine& machine, const Event& event)
+    {
+        if constexpr (!std::is_same_v<action_of<State, Event>, nothing>)
+        {
+            self.pass(state, machine, event);
+        }
+    }
+
+  private:
+    template<typename State, typename Event>
+    using action_of = type_of_t<decltype(resolve_action{}(types<State, Event>{}))>;
+
+    template<typename State, typename Self, typename Machine, typename Event>
+    static void invoke(Self& self, Machine& machine, const Event& event)
+    {
+        pass(self, self.template get<State>(), machine, event);
+    }
+
+    struct ignored_mask
+    {
+        template<typename... States, typename Event>
+        constexpr auto operator()(types<types<States, Event>>...) const
+        {
+            return std::array<bool, sizeof...(States)>{
+              std::is_same_v<action_of<States, Event>, nothing>...};
+        }
+    };
+
+    template<std::size_t N>
+    static constexpr bool all_of(const std::array<bool, N>& mask)
+    {
+        for (bool bit : mask)
+        {
+            if (!bit)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename Self, typename Machine>
+    struct make_thunks
+    {
+        template<typename... States, typename Event>
+        constexpr auto operator()(types<types<States, Event>>...) const
+        {
+            using thunk = void (*)(Self&, Machine&, const Event&);
+            return std::array<thunk, sizeof...(States)>{&invoke<States, Self, Machine, Event>...};
+        }
+    };
+
+    template<typename... States,
+             std::size_t... Idx,
+             typename Self,
+             typename Machine,
+             typename Event>
+    static void by_switch(types<States...>,
+                          std::index_sequence<Idx...>,
+                          Self&        self,
+                          Machine&     machine,
+                          const Event& event)
+    {
+        const std::size_t index = self.storage.index();
+        ((index == Idx && (invoke<States>(self, machine, event), true)) || ...);
+    }
+};
+
+} // namespace state_machine
+
+#endif // DISPATCH_H
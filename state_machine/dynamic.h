@@ -0,0 +1,437 @@
+#ifndef DYNAMIC_H
+#define DYNAMIC_H
+
+#include "packed_table.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace state_machine
+{
+
+// Event of a machine defined at run time: its column in the table, and
+// whatever the hooks and guards need to see of it
+struct dynamic_event
+{
+    std::uint16_t code    = 0;
+    const void*   payload = nullptr;
+};
+
+class dynamic_machine;
+
+using dynamic_hook  = void (*)(void* context, dynamic_machine& machine, const dynamic_event& event);
+using dynamic_guard = bool (*)(void*                  context,
+                               const dynamic_machine& machine,
+                               const dynamic_event&   event);
+
+// Transition table of a machine known only at run time, shared by all its
+// instances. Cells live in one flat, cache-aligned [state][event] array,
+// so a step costs one indexed load and a branch on the action kind, like
+// table_dispatch does for compiled machines. Actions are nothing,
+// transition_to<State> or maybe<transition_to<State>>, the latter passing
+// only when the guard bound to the pair returns true.
+//
+// Hooks and guards are bound by state and event name. A table must outlive,
+// and not be moved while there are, machines using it.
+class dynamic_table
+{
+  public:
+    // Reads the shape generate_transition_table and
+    // generate_pretty_transition_table print: a header row of event names,
+    // then one row per state, cells separated by '|'. nullopt when a row is
+    // malformed or a name is unknown or repeated.
+    static std::optional<dynamic_table> parse(std::string_view text)
+    {
+        std::vector<std::vector<std::string>> rows;
+        while (!text.empty())
+        {
+            const std::size_t end  = text.find('\n');
+            const auto        line = text.substr(0, end);
+            text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+            if (trim(line).empty())
+            {
+                continue;
+            }
+
+            std::vector<std::string> cells;
+            for (std::string_view rest = line;;)
+            {
+                const std::size_t bar = rest.find('|');
+                cells.emplace_back(trim(rest.substr(0, bar)));
+                if (bar == std::string_view::npos)
+                {
+                    break;
+                }
+                rest.remove_prefix(bar + 1);
+            }
+            rows.push_back(std::move(cells));
+        }
+
+        if (rows.size() < 2 || !rows[0][0].empty())
+        {
+            return std::nullopt;
+        }
+
+        std::vector<std::string> states;
+        for (std::size_t r = 1; r < rows.size(); ++r)
+        {
+            states.push_back(rows[r][0]);
+        }
+        dynamic_table table{std::move(states), {rows[0].begin() + 1, rows[0].end()}};
+        if (!table.valid())
+        {
+            return std::nullopt;
+        }
+
+        for (std::size_t r = 1; r < rows.size(); ++r)
+        {
+            if (rows[r].size() != table.events + 1)
+            {
+                return std::nullopt;
+            }
+            for (std::size_t e = 0; e < table.events; ++e)
+            {
+                if (!table.define(r - 1, e, rows[r][e + 1]))
+                {
+                    return std::nullopt;
+                }
+            }
+        }
+        return table;
+    }
+
+    // Takes a table read back by load_transition_table; nullopt when it
+    // has choices or custom actions, which need compiled code, or a maybe
+    // with several targets
+    static std::optional<dynamic_table> from_packed(const packed_table& packed)
+    {
+        dynamic_table table{packed.states, packed.events};
+        if (!table.valid())
+        {
+            return std::nullopt;
+        }
+
+        for (const packed_entry& entry : packed.entries)
+        {
+            if (entry.kind == action_kind::ignore)
+            {
+                continue;
+            }
+            // A maybe<one_of<...>> has one entry per target, but a cell
+            // only holds one
+            if ((entry.kind != action_kind::transition && entry.kind != action_kind::maybe)
+                || entry.target >= packed.states.size()
+                || table.at(entry.state, entry.event).kind != action_kind::ignore)
+            {
+                return std::nullopt;
+            }
+            table.set(entry.state, entry.event, entry.kind, entry.target);
+        }
+        return table;
+    }
+
+    dynamic_table(dynamic_table&&) = default;
+    dynamic_table& operator=(dynamic_table&&) = default;
+
+    std::size_t state_count() const
+    {
+        return states;
+    }
+
+    std::size_t event_count() const
+    {
+        return events;
+    }
+
+    std::optional<std::uint16_t> state(std::string_view name) const
+    {
+        return find(stateNames, name);
+    }
+
+    std::optional<std::uint16_t> event(std::string_view name) const
+    {
+        return find(eventNames, name);
+    }
+
+    const std::string& state_name(std::uint16_t index) const
+    {
+        return stateNames[index];
+    }
+
+    const std::string& event_name(std::uint16_t index) const
+    {
+        return eventNames[index];
+    }
+
+    // Each returns false when a name is unknown, or for guard() when the
+    // pair is not a maybe
+    bool on_enter(std::string_view state, dynamic_hook hook, void* context = nullptr)
+    {
+        return bind(enter, state, hook, context);
+    }
+
+    bool on_leave(std::string_view state, dynamic_hook hook, void* context = nullptr)
+    {
+        return bind(leave, state, hook, context);
+    }
+
+    bool guard(std::string_view state,
+               std::string_view event,
+               dynamic_guard    fn,
+               void*            context = nullptr)
+    {
+        const auto s = find(stateNames, state);
+        const auto e = find(eventNames, event);
+        if (!s || !e || at(*s, *e).kind != action_kind::maybe)
+        {
+            return false;
+        }
+        guards[at(*s, *e).guard] = {fn, context};
+        return true;
+    }
+
+    // Every maybe pair has a guard; unguarded pairs never pass
+    bool bound() const
+    {
+        for (const auto& g : guards)
+        {
+            if (g.fn == nullptr)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    friend class dynamic_machine;
+
+    struct alignas(8) cell
+    {
+        std::uint16_t target = 0;
+        std::uint16_t guard  = 0;
+        action_kind   kind   = action_kind::ignore;
+    };
+
+    template<typename Fn>
+    struct binding
+    {
+        Fn    fn      = nullptr;
+        void* context = nullptr;
+    };
+
+    struct aligned_delete
+    {
+        void operator()(cell* cells) const
+        {
+            ::operator delete(cells, std::align_val_t{64});
+        }
+    };
+
+    dynamic_table(std::vector<std::string> stateNames, std::vector<std::string> eventNames)
+      : states(stateNames.size())
+      , events(eventNames.size())
+      , stateNames(std::move(stateNames))
+      , eventNames(std::move(eventNames))
+      , cells(allocate(states * events))
+      , enter(states)
+      , leave(states)
+    {
+        std::uninitialized_fill_n(cells.get(), states * events, cell{});
+    }
+
+    static cell* allocate(std::size_t count)
+    {
+        const std::size_t bytes = std::max<std::size_t>(count, 1) * sizeof(cell);
+        return static_cast<cell*>(::operator new(bytes, std::align_val_t{64}));
+    }
+
+    static std::string_view trim(std::string_view text)
+    {
+        const std::size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+        {
+            return {};
+        }
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    static std::optional<std::uint16_t> find(const std::vector<std::string>& names,
+                                             std::string_view                name)
+    {
+        for (std::size_t i = 0; i < names.size(); ++i)
+        {
+            if (names[i] == name)
+            {
+                return static_cast<std::uint16_t>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    static bool unique(const std::vector<std::string>& names)
+    {
+        for (std::size_t i = 0; i < names.size(); ++i)
+        {
+            if (names[i].empty() || find(names, names[i]) != i)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool valid() const
+    {
+        return states != 0 && states < no_target && events != 0 && events <= 0xffff
+               && unique(stateNames) && unique(eventNames);
+    }
+
+    cell& at(std::size_t state, std::size_t event) const
+    {
+        return cells[state * events + event];
+    }
+
+    void set(std::size_t state, std::size_t event, action_kind kind, std::uint16_t target)
+    {
+        cell& c  = at(state, event);
+        c.kind   = kind;
+        c.target = target;
+        if (kind == action_kind::maybe)
+        {
+            c.guard = static_cast<std::uint16_t>(guards.size());
+            guards.emplace_back();
+        }
+    }
+
+    // Cell text: nothing, transition_to<S> or maybe<transition_to<S>>
+    bool define(std::size_t state, std::size_t event, std::string_view action)
+    {
+        if (action == "nothing")
+        {
+            return true;
+        }
+
+        action_kind kind = action_kind::transition;
+        if (unwrap(action, "maybe<"))
+        {
+            kind = action_kind::maybe;
+        }
+        if (!unwrap(action, "transition_to<"))
+        {
+            return false;
+        }
+
+        const auto target = find(stateNames, action);
+        if (!target || (kind == action_kind::maybe && guards.size() == 0xffff))
+        {
+            return false;
+        }
+        set(state, event, kind, *target);
+        return true;
+    }
+
+    static bool unwrap(std::string_view& text, std::string_view prefix)
+    {
+        if (text.size() <= prefix.size() || text.substr(0, prefix.size()) != prefix
+            || text.back() != '>')
+        {
+            return false;
+        }
+        text = text.substr(prefix.size(), text.size() - prefix.size() - 1);
+        return true;
+    }
+
+    bool bind(std::vector<binding<dynamic_hook>>& hooks,
+              std::string_view                    state,
+              dynamic_hook                        hook,
+              void*                               context)
+    {
+        const auto s = find(stateNames, state);
+        if (!s)
+        {
+            return false;
+        }
+        hooks[*s] = {hook, context};
+        return true;
+    }
+
+    std::size_t                              states;
+    std::size_t                              events;
+    std::vector<std::string>                 stateNames;
+    std::vector<std::string>                 eventNames;
+    std::unique_ptr<cell[], aligned_delete>  cells;
+    std::vector<binding<dynamic_hook>>       enter;
+    std::vector<binding<dynamic_hook>>       leave;
+    std::vector<binding<dynamic_guard>>      guards;
+};
+
+// Instance of a runtime-defined machine: the index of its current state
+class dynamic_machine
+{
+  public:
+    explicit dynamic_machine(const dynamic_table& table, std::uint16_t initial = 0)
+      : table(&table)
+      , state(initial)
+    {
+    }
+
+    std::uint16_t current() const
+    {
+        return state;
+    }
+
+    // event.code must be below the table's event_count()
+    void handle(const dynamic_event& event)
+    {
+        const dynamic_table::cell& c = table->at(state, event.code);
+        if (c.kind == action_kind::ignore)
+        {
+            return;
+        }
+        if (c.kind == action_kind::maybe)
+        {
+            const auto& g = table->guards[c.guard];
+            if (g.fn == nullptr || !g.fn(g.context, *this, event))
+            {
+                return;
+            }
+        }
+
+        const auto& leave = table->leave[state];
+        if (leave.fn != nullptr)
+        {
+            leave.fn(leave.context, *this, event);
+        }
+        state            = c.target;
+        const auto& enter = table->enter[state];
+        if (enter.fn != nullptr)
+        {
+            enter.fn(enter.context, *this, event);
+        }
+    }
+
+    void handle_batch(const dynamic_event* first, const dynamic_event* last)
+    {
+        for (; first != last; ++first)
+        {
+            handle(*first);
+        }
+    }
+
+  private:
+    const dynamic_table* table;
+    std::uint16_t        state;
+};
+
+} // namespace state_machine
+
+#endif // DYNAMIC_H
@@ -0,0 +1,90 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace state_machine
+{
+
+// Run-to-completion driver for a machine. It is passed to actions in place
+// of the machine itself, so an action can post() follow-up events instead of
+// recursing into handle_by. Follow-up events are processed after the event
+// that posted them completes and before the next event of the batch.
+template<typename Machine, typename... Events>
+class event_queue
+{
+  public:
+    using event = std::variant<Events...>;
+
+    explicit event_queue(Machine& machine)
+      : machine(machine)
+    {
+    }
+
+    template<typename State, typename... Args>
+    State& transition(Args&&... args)
+    {
+        return machine.template transition<State>(std::forward<Args>(args)...);
+    }
+
+    template<typename Event>
+    void post(Event&& event)
+    {
+        pending.emplace_back(std::forward<Event>(event));
+    }
+
+    bool has_pending() const
+    {
+        return head != pending.size();
+    }
+
+    template<typename Event>
+    void handle(const Event& event)
+    {
+        machine.handle_by(event, *this);
+        drain();
+    }
+
+    void handle(const event* first, const event* last)
+    {
+        while (first != last)
+        {
+            first = machine.handle_batch_by(first, last, *this);
+            drain();
+        }
+    }
+
+    template<typename Range>
+    void handle_batch(const Range& events)
+    {
+        const event* first = std::data(events);
+        handle(first, first + std::size(events));
+    }
+
+  private:
+    void drain()
+    {
+        // Posting may reallocate the queue, so every event is moved out of
+        // it before being handled.
+        while (has_pending())
+        {
+            event next = std::move(pending[head++]);
+            machine.handle_batch_by(&next, &next + 1, *this);
+        }
+
+        pending.clear();
+        head = 0;
+    }
+
+    Machine&           machine;
+    std::vector<event> pending;
+    std::size_t        head = 0;
+};
+
+} // namespace state_machine
+
+#endif // EVENT_QUEUE_H
@@ -0,0 +1,195 @@
+#ifndef INBOX_H
+#define INBOX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <variant>
+
+namespace state_machine
+{
+
+// Bounded lock-free multi-producer/single-consumer event inbox for a machine.
+// Any thread may post(); only the thread owning the machine may drain() or
+// run(). Every cell carries a sequence number telling whether it is free for
+// the producer that claimed its position or ready for the consumer.
+template<typename Machine, typename... Events>
+class inbox
+{
+  public:
+    using event = std::variant<Events...>;
+
+    static constexpr std::size_t cache_line = 64;
+
+    // capacity is rounded up to a power of two
+    inbox(Machine& machine, std::size_t capacity)
+      : machine(machine)
+      , mask(round_up(capacity) - 1)
+      , cells(new cell[mask + 1])
+    {
+        for (std::size_t i = 0; i <= mask; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    inbox(const inbox&) = delete;
+    inbox& operator=(const inbox&) = delete;
+
+    ~inbox()
+    {
+        while (consume([](event&) {}))
+        {
+        }
+    }
+
+    // Returns false without blocking when the ring is full; the rejection is
+    // counted in overflows().
+    template<typename Event>
+    bool post(Event&& e)
+    {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        cell*       target;
+
+        for (;;)
+        {
+            target = &cells[pos & mask];
+            const std::size_t seq = target->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (target->storage) event(std::forward<Event>(e));
+        target->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Spins (yielding between attempts) until the event fits
+    template<typename Event>
+    void post_wait(const Event& e)
+    {
+        while (!post(e))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // Handles every event published so far; returns how many were handled
+    std::size_t drain()
+    {
+        std::size_t handled = 0;
+        auto        passToMachine = [this](event& e) {
+            std::visit([this](const auto& ev) { machine.handle(ev); }, e);
+        };
+
+        while (consume(passToMachine))
+        {
+            ++handled;
+        }
+
+        return handled;
+    }
+
+    // Drain loop for the owning thread: handles events until stop is set and
+    // the ring is empty, spinning for a while before yielding when idle.
+    void run(const std::atomic<bool>& stop)
+    {
+        constexpr unsigned spinLimit = 64;
+        unsigned           idle = 0;
+
+        for (;;)
+        {
+            if (drain() != 0)
+            {
+                idle = 0;
+            }
+            else if (stop.load(std::memory_order_acquire))
+            {
+                if (drain() == 0)
+                {
+                    return;
+                }
+            }
+            else if (++idle > spinLimit)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    std::size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    std::uint64_t overflows() const
+    {
+        return rejected.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct cell
+    {
+        std::atomic<std::size_t> sequence;
+        alignas(event) unsigned char storage[sizeof(event)];
+    };
+
+    static std::size_t round_up(std::size_t capacity)
+    {
+        std::size_t result = 1;
+        while (result < capacity)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    template<typename Consumer>
+    bool consume(Consumer&& consumer)
+    {
+        cell& source = cells[head & mask];
+        if (source.sequence.load(std::memory_order_acquire) != head + 1)
+        {
+            return false;
+        }
+
+        event* e = std::launder(reinterpret_cast<event*>(source.storage));
+        consumer(*e);
+        e->~event();
+
+        source.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+    Machine&                      machine;
+    const std::size_t             mask;
+    std::unique_ptr<cell[]>       cells;
+    alignas(cache_line) std::atomic<std::size_t> tail{0};
+    alignas(cache_line) std::atomic<std::uint64_t> rejected{0};
+    alignas(cache_line) std::size_t head = 0;
+};
+
+} // namespace state_machine
+
+#endif // INBOX_H
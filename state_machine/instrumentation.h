@@ -0,0 +1,224 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include "table.h"
+#include "types/types.h"
+#include "types/util.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+namespace state_machine
+{
+
+// Default: dispatch is compiled exactly as without instrumentation
+struct no_instrumentation
+{
+    static constexpr bool enabled = false;
+};
+
+// Per-(state, event) hit counters and log2 latency histograms (in ns) of the
+// handle and execute phases; execute includes on_leave/on_enter. Counters
+// are kept per machine type in one block per thread, written by that thread
+// only, so recording never contends. Events outside the list are not
+// recorded.
+template<typename... Events>
+struct profiler
+{
+    static constexpr bool enabled = true;
+
+    using events = types<Events...>;
+};
+
+template<typename Machine, std::size_t StateCount, std::size_t EventCount>
+class transition_stats
+{
+  public:
+    // bucket b counts latencies below 2^b ns, the last one everything above
+    static constexpr std::size_t buckets = 16;
+
+    struct cell
+    {
+        std::uint64_t                      hits = 0;
+        std::array<std::uint64_t, buckets> handle{};
+        std::array<std::uint64_t, buckets> execute{};
+    };
+
+    using snapshot = std::array<std::array<cell, EventCount>, StateCount>;
+
+    static void record(std::size_t   state,
+                       std::size_t   event,
+                       std::uint64_t handleNs,
+                       std::uint64_t executeNs)
+    {
+        counters& c = local().cells[state * EventCount + event];
+        bump(c.hits);
+        bump(c.handle[bucket(handleNs)]);
+        bump(c.execute[bucket(executeNs)]);
+    }
+
+    // Sums the blocks of all threads that have recorded so far
+    static snapshot collect()
+    {
+        snapshot result{};
+        for (block* b = head.load(std::memory_order_acquire); b != nullptr; b = b->next)
+        {
+            for (std::size_t s = 0; s < StateCount; ++s)
+            {
+                for (std::size_t e = 0; e < EventCount; ++e)
+                {
+                    const counters& from = b->cells[s * EventCount + e];
+                    cell&           to   = result[s][e];
+                    to.hits += from.hits.load(std::memory_order_relaxed);
+                    for (std::size_t i = 0; i < buckets; ++i)
+                    {
+                        to.handle[i] += from.handle[i].load(std::memory_order_relaxed);
+                        to.execute[i] += from.execute[i].load(std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+  private:
+    struct counters
+    {
+        std::atomic<std::uint64_t>                      hits{0};
+        std::array<std::atomic<std::uint64_t>, buckets> handle{};
+        std::array<std::atomic<std::uint64_t>, buckets> execute{};
+    };
+
+    struct block
+    {
+        std::array<counters, StateCount * EventCount> cells;
+        block*                                        next = nullptr;
+    };
+
+    static void bump(std::atomic<std::uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static std::size_t bucket(std::uint64_t ns)
+    {
+        std::size_t b = 0;
+        while (b + 1 < buckets && (ns >> b) != 0)
+        {
+            ++b;
+        }
+        return b;
+    }
+
+    // Blocks outlive their threads so their counts stay in later snapshots
+    static block& local()
+    {
+        thread_local block* mine = [] {
+            block* b = new block;
+            b->next  = head.load(std::memory_order_relaxed);
+            while (!head.compare_exchange_weak(b->next, b, std::memory_order_release))
+            {
+            }
+            return b;
+        }();
+        return *mine;
+    }
+
+    static inline std::atomic<block*> head{nullptr};
+};
+
+template<typename Machine>
+using machine_stats =
+  transition_stats<Machine,
+                   size(Machine::get_state_types()),
+                   size(typename Machine::policy::instrumentation::events{})>;
+
+namespace detail
+{
+
+template<std::size_t Width, typename T>
+std::string label(types<T> type)
+{
+    std::string text = stringify(type).data();
+    text.resize(Width, ' ');
+    return text;
+}
+
+template<std::size_t Buckets>
+std::string percentile(const std::array<std::uint64_t, Buckets>& histogram,
+                       std::uint64_t                             hits,
+                       double                                    fraction)
+{
+    std::uint64_t seen = 0;
+    for (std::size_t b = 0; b < Buckets; ++b)
+    {
+        seen += histogram[b];
+        if (seen != 0 && seen >= fraction * hits)
+        {
+            return b + 1 < Buckets ? "<" + std::to_string(std::uint64_t{1} << b) + "ns"
+                                   : ">=" + std::to_string(std::uint64_t{1} << (b - 1)) + "ns";
+        }
+    }
+    return "-";
+}
+
+template<std::size_t Width, typename Machine, typename State, typename... Events>
+void print_row(std::ostream&                                    out,
+               const typename machine_stats<Machine>::snapshot& stats,
+               std::size_t                                      state,
+               types<State>                                     stateType,
+               types<Events...>)
+{
+    std::size_t event     = 0;
+    auto        printCell = [&](auto eventType) {
+        const auto& cell = stats[state][event++];
+        if (cell.hits == 0)
+        {
+            return;
+        }
+
+        using Event = type_of_t<decltype(eventType)>;
+        out << label<Width>(stateType) << " | " << label<Width>(eventType) << " | "
+            << label<Width>(resolve_action{}(types<State, Event>{})) << " | " << std::setw(12)
+            << cell.hits << " | handle p50 " << percentile(cell.handle, cell.hits, 0.5)
+            << " p99 " << percentile(cell.handle, cell.hits, 0.99) << " | execute p50 "
+            << percentile(cell.execute, cell.hits, 0.5) << " p99 "
+            << percentile(cell.execute, cell.hits, 0.99) << '\n';
+    };
+
+    (printCell(types<Events>{}), ...);
+}
+
+template<std::size_t Width, typename Machine, typename... States, typename Events>
+void print_rows(std::ostream&                                    out,
+                const typename machine_stats<Machine>::snapshot& stats,
+                types<States...>,
+                Events events)
+{
+    std::size_t state = 0;
+    (print_row<Width, Machine>(out, stats, state++, types<States>{}, events), ...);
+}
+
+} // namespace detail
+
+// Prints every (state, event) pair that fired, labelled and padded the same
+// way as generate_pretty_transition_table
+template<typename Machine>
+void print_transition_stats(std::ostream& out)
+{
+    constexpr auto states = Machine::get_state_types();
+    constexpr auto events = typename Machine::policy::instrumentation::events{};
+
+    detail::print_rows<label_width(states, events), Machine>(
+      out, machine_stats<Machine>::collect(), states, events);
+}
+
+} // namespace state_machine
+
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,322 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace state_machine
+{
+
+// Append-only journal of events. The file starts with a 16-byte header
+// ("SMJL", u32 version, u32 event count, u32 layout fingerprint) followed by
+// one record per event: a byte holding the index of its type in Events,
+// then the raw bytes of the event (none for empty events). Integers are in
+// native byte order, so a journal is replayed by the same build that wrote
+// it.
+template<typename... Events>
+class journal_format
+{
+    static_assert(sizeof...(Events) <= 256, "event index must fit in a byte");
+    static_assert((std::is_trivially_copyable_v<Events> && ...),
+                  "journaled events must be trivially copyable");
+
+  public:
+    static constexpr std::uint32_t version     = 1;
+    static constexpr std::size_t   header_size = 16;
+
+    // Record size, type byte included, of every event type
+    static constexpr std::array<std::size_t, sizeof...(Events)> record_sizes{
+      1 + (std::is_empty_v<Events> ? 0 : sizeof(Events))...};
+
+    static constexpr std::uint32_t layout()
+    {
+        std::uint32_t hash = 2166136261u;
+        for (std::size_t size : record_sizes)
+        {
+            hash = (hash ^ static_cast<std::uint32_t>(size)) * 16777619u;
+        }
+        return hash;
+    }
+
+    static std::array<std::uint8_t, header_size> header()
+    {
+        std::array<std::uint8_t, header_size> bytes{'S', 'M', 'J', 'L'};
+        const std::uint32_t fields[] = {version, sizeof...(Events), layout()};
+        std::memcpy(bytes.data() + 4, fields, sizeof(fields));
+        return bytes;
+    }
+
+    template<typename Event>
+    static constexpr std::uint8_t event_index()
+    {
+        static_assert((std::is_same_v<Event, Events> || ...),
+                      "event is not one of the journal's events");
+        std::size_t index = 0;
+        (void)((std::is_same_v<Event, Events> || (++index, false)) || ...);
+        return static_cast<std::uint8_t>(index);
+    }
+};
+
+// Buffers records in memory and writes them with one write() when the
+// buffer fills up. commit() additionally makes everything appended so far
+// durable with a single fdatasync(), so callers group as many events per
+// commit as their latency budget allows. An existing journal written for
+// other events is not appended to; the writer is then not good(). One that
+// ends in a record torn by a crash is cut back to its last complete record
+// before appending.
+template<typename... Events>
+class journal_writer
+{
+    using format = journal_format<Events...>;
+
+  public:
+    explicit journal_writer(const char* path, std::size_t capacity = 1 << 20)
+      : fd(::open(path, O_RDWR | O_CREAT | O_APPEND, 0644))
+    {
+        buffer.reserve(std::max(capacity, format::header_size));
+
+        const auto  header = format::header();
+        struct stat info;
+        if (!ok || ::fstat(fd, &info) != 0)
+        {
+            ok = false;
+        }
+        else if (info.st_size == 0)
+        {
+            buffer.insert(buffer.end(), header.begin(), header.end());
+        }
+        else
+        {
+            std::array<std::uint8_t, format::header_size> existing{};
+            ok = ::pread(fd, existing.data(), existing.size(), 0) == ssize_t(existing.size())
+                 && existing == header && drop_torn_record(info.st_size);
+        }
+    }
+
+    journal_writer(const journal_writer&) = delete;
+    journal_writer& operator=(const journal_writer&) = delete;
+
+    ~journal_writer()
+    {
+        if (fd >= 0)
+        {
+            commit();
+            ::close(fd);
+        }
+    }
+
+    // false once opening, validating, writing or syncing the journal failed
+    bool good() const
+    {
+        return ok;
+    }
+
+    // Returns false, and drops the record, once the writer is not good()
+    template<typename Event>
+    bool append(const Event& event)
+    {
+        constexpr std::uint8_t index = format::template event_index<Event>();
+        constexpr std::size_t  size  = format::record_sizes[index];
+        if (!ok || (buffer.size() + size > buffer.capacity() && !flush()))
+        {
+            return false;
+        }
+
+        const std::size_t offset = buffer.size();
+        buffer.resize(offset + size);
+        buffer[offset] = index;
+        if constexpr (size > 1)
+        {
+            std::memcpy(&buffer[offset + 1], &event, size - 1);
+        }
+        return true;
+    }
+
+    template<typename... Ts>
+    bool append(const std::variant<Ts...>& event)
+    {
+        return std::visit([this](const auto& e) { return append(e); }, event);
+    }
+
+    // Writes out the buffered records without waiting for the disk. Returns
+    // false when any of them, or of the records buffered before an earlier
+    // failure, was not written; they are discarded either way, and a record
+    // written only in part is cut off when the journal is next opened.
+    bool flush()
+    {
+        const std::uint8_t* cursor = buffer.data();
+        std::size_t         left   = buffer.size();
+        while (left != 0 && ok)
+        {
+            const ssize_t written = ::write(fd, cursor, left);
+            ok                    = written > 0;
+            cursor += ok ? written : 0;
+            left -= ok ? written : 0;
+        }
+        buffer.clear();
+        return ok;
+    }
+
+    bool commit()
+    {
+        return flush() && (ok = ::fdatasync(fd) == 0);
+    }
+
+  private:
+    // Truncates the journal of `size` bytes, header included, after its
+    // last complete record. Fails on an unknown event index, which is not
+    // the trace of an interrupted write.
+    bool drop_torn_record(std::size_t size)
+    {
+        void* base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+
+        const auto* records = static_cast<const std::uint8_t*>(base);
+        std::size_t end     = format::header_size;
+        while (end != size && records[end] < sizeof...(Events)
+               && format::record_sizes[records[end]] <= size - end)
+        {
+            end += format::record_sizes[records[end]];
+        }
+        const bool torn  = end != size && records[end] < sizeof...(Events);
+        const bool known = end == size || torn;
+        ::munmap(base, size);
+        return known && (!torn || ::ftruncate(fd, end) == 0);
+    }
+
+    int                       fd;
+    bool                      ok = fd >= 0;
+    std::vector<std::uint8_t> buffer;
+};
+
+// Driver that journals every event before handing it to the machine
+template<typename Machine, typename... Events>
+class journaled
+{
+  public:
+    journaled(Machine& machine, journal_writer<Events...>& journal)
+      : machine(machine)
+      , journal(journal)
+    {
+    }
+
+    // The event reaches the machine only once it is in the journal, so the
+    // two never drift apart; returns false, leaving the machine as it was,
+    // when the journal has failed
+    template<typename Event>
+    bool handle(const Event& event)
+    {
+        if (!journal.append(event))
+        {
+            return false;
+        }
+        machine.handle(event);
+        return true;
+    }
+
+  private:
+    Machine&                   machine;
+    journal_writer<Events...>& journal;
+};
+
+struct replay_result
+{
+    std::size_t events = 0;
+    // false when the journal could not be opened, does not match Events or
+    // ends in a torn or unknown record; events counts what was replayed
+    bool complete = false;
+};
+
+// Streams a journal through machine.handle_batch in batches of `batch`
+// events. The file is mapped with sequential readahead and decoded into one
+// reused batch buffer, so replay makes no syscall or allocation per record.
+// Events must be default-constructible.
+template<typename... Events, typename Machine>
+replay_result replay_journal(const char* path, Machine& machine, std::size_t batch = 4096)
+{
+    using format = journal_format<Events...>;
+    using event  = std::variant<Events...>;
+    using decode = const std::uint8_t* (*)(const std::uint8_t*, event&);
+
+    static constexpr decode decoders[] = {[](const std::uint8_t* payload, event& slot) {
+        Events e{};
+        if constexpr (!std::is_empty_v<Events>)
+        {
+            std::memcpy(&e, payload, sizeof(Events));
+        }
+        slot = e;
+        return payload + (std::is_empty_v<Events> ? 0 : sizeof(Events));
+    }...};
+
+    replay_result result;
+    const int     fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return result;
+    }
+
+    struct stat info;
+    void*       base = MAP_FAILED;
+    if (::fstat(fd, &info) == 0 && std::size_t(info.st_size) >= format::header_size)
+    {
+        base = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        return result;
+    }
+    ::madvise(base, info.st_size, MADV_SEQUENTIAL);
+    ::madvise(base, info.st_size, MADV_WILLNEED);
+
+    const auto*               cursor = static_cast<const std::uint8_t*>(base);
+    const std::uint8_t* const end    = cursor + info.st_size;
+    const auto                header = format::header();
+    bool                      valid  = std::memcmp(cursor, header.data(), header.size()) == 0;
+    cursor += format::header_size;
+
+    std::vector<event> events(std::max<std::size_t>(batch, 1));
+    while (valid && cursor != end)
+    {
+        std::size_t count = 0;
+        while (count != events.size() && cursor != end)
+        {
+            const std::uint8_t index = *cursor;
+            if (index >= sizeof...(Events) || format::record_sizes[index] > std::size_t(end - cursor))
+            {
+                valid = false;
+                break;
+            }
+            cursor = decoders[index](cursor + 1, events[count++]);
+        }
+
+        if (count != 0)
+        {
+            machine.handle_batch(events.data(), events.data() + count);
+        }
+        result.events += count;
+    }
+
+    ::munmap(base, info.st_size);
+    result.complete = valid;
+    return result;
+}
+
+} // namespace state_machine
+
+#endif // JOURNAL_H
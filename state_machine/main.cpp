@@ -1,13 +1,32 @@
+#include "analysis.h"
+#include "bulk.h"
+#include "dynamic.h"
+#include "event_queue.h"
+#include "journal.h"
+#include "packed_table.h"
+#include "pool.h"
+#include "sharded.h"
+#include "snapshot.h"
+#include "table.h"
+#include "timer_wheel.h"
+#include "state_machine.h"
 #include "types/resolve.h"
 #include "types/types.h"
 #include "types/util.h"
 #include "util/static_string.h"
 
+#include <cstdio>
+#include <filesystem>
 #include <functional>
 #include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <variant>
+#include <vector>
 
 template<typename T>
 void debug(T&&)
@@ -15,105 +34,105 @@ void debug(T&&)
     std::cout << __PRETTY_FUNCTION__ << std::endl;
 }
 
-#define STRINGIFY_IMPL(TYPE)                                                     \
-    [[maybe_unused]] static constexpr auto stringify(state_machine::types<TYPE>) \
-    {                                                                            \
-        return static_string{#TYPE};                                             \
-    }
+using namespace std;
+namespace sm = state_machine;
 
-namespace state_machine
+struct OpenEvent
 {
+};
 
-template<typename Event, typename Action>
-struct on
+struct CloseEvent
 {
-    Action handle(const Event&) const
-    {
-        return Action{};
-    }
 };
 
-template<typename... States>
-class state_machine
+struct LockEvent
 {
-  public:
-    state_machine() = default;
-    state_machine(States... states)
-      : states(std::move(states)...)
-    {
-    }
+    uint32_t newKey;
+};
 
-    template<typename State>
-    State& transition()
-    {
-        State& state = std::get<State>(states);
-        currentState = &state;
-        return state;
-    }
+struct UnlockEvent
+{
+    uint32_t key;
+};
 
-    template<typename Event>
-    void handle(const Event& event)
+struct OpenState;
+struct ClosedState;
+struct LockedState;
+
+struct ClosedState
+  : public sm::will<sm::by_default<sm::nothing>,
+                    sm::on<LockEvent, sm::transition_to<LockedState, sm::from_event<LockedState>>>,
+                    sm::on<OpenEvent, sm::transition_to<OpenState>>>
+{
+};
+
+struct OpenState
+  : public sm::will<sm::by_default<sm::nothing>, sm::on<CloseEvent, sm::transition_to<ClosedState>>>
+{
+};
+
+struct LockedState : public sm::by_default<sm::nothing>
+{
+    using sm::by_default<sm::nothing>::handle;
+
+    LockedState(uint32_t key)
+      : key(key)
     {
-        handle_by(event, *this);
     }
 
-    template<typename Event, typename Machine>
-    void handle_by(const Event& event, Machine& machine)
+    LockedState(const LockEvent& e)
+      : key(e.newKey)
     {
-        auto passEventToState = [&machine, &event](auto statePtr) {
-            auto action = statePtr->handle(event);
-            action.execute(machine, *statePtr, event);
-        };
-
-        std::visit(passEventToState, currentState);
     }
 
-    constexpr static types<States...> get_state_types()
+    sm::maybe<sm::transition_to<ClosedState>> handle(const UnlockEvent& e)
     {
-        return {};
+        if (e.key == key)
+        {
+            return sm::transition_to<ClosedState>{};
+        }
+        return sm::nothing{};
     }
 
   private:
-    std::tuple<States...>    states;
-    std::variant<States*...> currentState{&std::get<0>(states)};
+    uint32_t key;
 };
 
-template<typename TargetState>
-struct transition_to
+// A spring-loaded door: opening it posts the close that follows, which the
+// event queue runs before the next event of the batch
+struct SpringClosed;
+struct SpringOpen;
+
+struct spring_back
 {
     template<typename Machine, typename State, typename Event>
-    void execute(Machine& machine, State& prevState, const Event& event)
+    void execute(Machine& machine, State& state, const Event& event)
     {
-        leave(prevState, event);
-        TargetState& newState = machine.template transition<TargetState>();
-        enter(newState, event);
+        sm::transition_to<SpringOpen>{}.execute(machine, state, event);
+        machine.post(CloseEvent{});
     }
+};
 
-  private:
-    void leave(...) {}
-
-    template<typename State, typename Event>
-    auto leave(State& state, const Event& event) -> decltype(state.on_leave(event))
+struct SpringClosed : sm::will<sm::by_default<sm::nothing>, sm::on<OpenEvent, spring_back>>
+{
+    void on_enter(const CloseEvent&)
     {
-        return state.on_leave(event);
+        ++closings;
     }
 
-    void enter(...) {}
-
-    template<typename State, typename Event>
-    auto enter(State& state, const Event& event) -> decltype(state.on_enter(event))
-    {
-        return state.on_enter(event);
-    }
+    static inline int closings = 0;
 };
 
-template<typename State>
-static constexpr auto stringify(types<transition_to<State>>)
+struct SpringOpen
+  : sm::will<sm::by_default<sm::nothing>, sm::on<CloseEvent, sm::transition_to<SpringClosed>>>
 {
-    return static_string{"transition_to<"} + stringify(types<State>{}) + static_string{">"};
-}
+};
+
+// A latch only ever drawn: knocking runs an action that declares it leads
+// nowhere, and closing a choice that names the same state twice
+struct Latched;
 
-struct nothing
+struct knock
 {
     template<typename Machine, typename State, typename Event>
     void execute(Machine&, State&, const Event&)
@@ -121,126 +140,85 @@ struct nothing
     }
 };
 
-static constexpr auto stringify(types<nothing>)
+constexpr auto targets(sm::types<knock>)
 {
-    return static_string{"nothing"};
+    return sm::types<>{};
 }
 
-template<typename... Actions>
-struct one_of
+struct Unlatched
+  : sm::will<sm::by_default<sm::nothing>,
+             sm::on<OpenEvent, knock>,
+             sm::on<CloseEvent, sm::one_of<sm::transition_to<Latched>, sm::transition_to<Latched>>>>
 {
-    template<typename T>
-    one_of(T&& arg)
-      : options(std::forward<T>(arg))
-    {
-    }
-
-    template<typename Machine, typename State, typename Event>
-    void execute(Machine& machine, State& state, const Event& event)
-    {
-        std::visit(
-          [&machine, &state, &event](auto& action) {
-              action.execute(machine, state, event);
-          },
-          options);
-    }
-
-  private:
-    std::variant<Actions...> options;
 };
 
-template<typename Action>
-struct maybe : public one_of<Action, nothing>
+struct Latched : sm::will<sm::by_default<sm::nothing>>
 {
-    using one_of<Action, nothing>::one_of;
 };
 
-template<typename Action>
-static constexpr auto stringify(types<maybe<Action>>)
+// A lift: Running is a composite state of Waiting and Moving, entered in
+// Waiting, and a power cut stops it whatever substate it is in
+struct CallEvent
 {
-    return static_string{"maybe<"} + stringify(types<Action>{}) + static_string{">"};
-}
-
-template<typename Action>
-struct by_default
-{
-    template<typename Event>
-    Action handle(const Event&) const
-    {
-        return Action{};
-    }
 };
 
-template<typename... Handlers>
-struct will : Handlers...
+struct ArriveEvent
 {
-    using Handlers::handle...;
 };
 
-} // namespace state_machine
-
-using namespace std;
-namespace sm = state_machine;
-
-struct OpenEvent
+struct PowerCutEvent
 {
 };
 
-struct CloseEvent
+struct PowerOnEvent
 {
 };
 
-struct LockEvent
-{
-    uint32_t newKey;
-};
+struct WaitingState;
+struct MovingState;
+struct StoppedState;
 
-struct UnlockEvent
+template<typename State>
+struct counts_entries
 {
-    uint32_t key;
-};
+    template<typename Event>
+    void on_enter(const Event&)
+    {
+        ++entries;
+    }
 
-struct OpenState;
-struct ClosedState;
-struct LockedState;
+    static inline int entries = 0;
+};
 
-struct ClosedState
-  : public sm::will<sm::by_default<sm::nothing>,
-                    sm::on<LockEvent, sm::transition_to<LockedState>>,
-                    sm::on<OpenEvent, sm::transition_to<OpenState>>>
+struct RunningState
+  : sm::will<sm::by_default<sm::nothing>, sm::on<PowerCutEvent, sm::transition_to<StoppedState>>>
 {
+    using initial = WaitingState;
 };
 
-struct OpenState
-  : public sm::will<sm::by_default<sm::nothing>, sm::on<CloseEvent, sm::transition_to<ClosedState>>>
+struct WaitingState
+  : sm::in<RunningState, sm::on<CallEvent, sm::transition_to<MovingState>>>
+  , counts_entries<WaitingState>
 {
 };
 
-struct LockedState : public sm::by_default<sm::nothing>
+struct MovingState
+  : sm::in<RunningState, sm::on<ArriveEvent, sm::transition_to<WaitingState>>>
+  , counts_entries<MovingState>
 {
-    using sm::by_default<sm::nothing>::handle;
-
-    LockedState(uint32_t key)
-      : key(key)
-    {
-    }
-
-    void on_enter(const LockEvent& e)
-    {
-        key = e.newKey;
-    }
+    using sm::in<RunningState, sm::on<ArriveEvent, sm::transition_to<WaitingState>>>::handle;
 
-    sm::maybe<sm::transition_to<ClosedState>> handle(const UnlockEvent& e)
+    // Calls while moving are queued elsewhere
+    sm::nothing handle(const CallEvent&)
     {
-        if (e.key == key)
-        {
-            return sm::transition_to<ClosedState>{};
-        }
-        return sm::nothing{};
+        return {};
     }
+};
 
-  private:
-    uint32_t key;
+struct StoppedState
+  : sm::will<sm::by_default<sm::nothing>, sm::on<PowerOnEvent, sm::transition_to<RunningState>>>
+  , counts_entries<StoppedState>
+{
 };
 
 STRINGIFY_IMPL(OpenEvent)
@@ -250,179 +228,373 @@ STRINGIFY_IMPL(UnlockEvent)
 STRINGIFY_IMPL(ClosedState)
 STRINGIFY_IMPL(OpenState)
 STRINGIFY_IMPL(LockedState)
+STRINGIFY_IMPL(CallEvent)
+STRINGIFY_IMPL(ArriveEvent)
+STRINGIFY_IMPL(PowerCutEvent)
+STRINGIFY_IMPL(PowerOnEvent)
+STRINGIFY_IMPL(RunningState)
+STRINGIFY_IMPL(WaitingState)
+STRINGIFY_IMPL(MovingState)
+STRINGIFY_IMPL(StoppedState)
+STRINGIFY_IMPL(Unlatched)
+STRINGIFY_IMPL(Latched)
+
+struct table_policy : sm::default_policy
+{
+    using dispatch = sm::table_dispatch<>;
+};
+
+struct compact_policy : sm::default_policy
+{
+    template<typename... States>
+    using storage = sm::variant_storage<States...>;
+};
 
-struct Header
+struct profiled_policy : sm::default_policy
 {
+    using instrumentation = sm::profiler<OpenEvent, CloseEvent, LockEvent, UnlockEvent>;
 };
 
-struct simple_stringifier
+int main()
 {
-    constexpr auto operator()(state_machine::types<Header>) const
+    using SM = sm::state_machine<ClosedState, OpenState, LockedState>;
+
+    std::cout << generate_transition_table(
+                   SM::get_state_types(),
+                   sm::types<OpenEvent, CloseEvent, LockEvent, UnlockEvent>{})
+                   .data()
+              << std::endl;
+    std::cout << generate_pretty_transition_table(
+                   SM::get_state_types(),
+                   sm::types<OpenEvent, CloseEvent, LockEvent, UnlockEvent>{})
+                   .data()
+              << std::endl;
+
+    constexpr auto analysis = sm::analyze(SM::get_state_types(),
+                                          sm::types<OpenEvent, CloseEvent, LockEvent, UnlockEvent>{});
+    static_assert(analysis.reachable[2] && !analysis.absorbing[2] && analysis.ignored[2][0]);
+
+    // Without LockEvent the locked state is unreachable, so it is dropped
+    using Unlockable =
+      sm::pruned_state_machine<sm::default_policy,
+                               sm::types<OpenEvent, CloseEvent>,
+                               ClosedState,
+                               OpenState,
+                               LockedState>;
+    static_assert(
+      std::is_same_v<decltype(Unlockable::get_state_types()), sm::types<ClosedState, OpenState>>);
+    Unlockable unlockable;
+    unlockable.handle(OpenEvent{});
+    unlockable.handle(CloseEvent{});
+
+    // Substates fall back to their parent, and entering the parent enters
+    // its initial substate
+    using Lift       = sm::state_machine<WaitingState, MovingState, StoppedState>;
+    using LiftEvents = sm::types<CallEvent, ArriveEvent, PowerCutEvent, PowerOnEvent>;
+    std::cout << generate_pretty_transition_table(Lift::get_state_types(), LiftEvents{}).data()
+              << std::endl;
+    constexpr auto lift = sm::analyze(Lift::get_state_types(), LiftEvents{});
+    static_assert(lift.edges[0][2] && lift.edges[1][2] && lift.edges[2][0] && !lift.edges[2][1]);
+    static_assert(lift.ignored[1][0] && !lift.ignored[1][2]);
+
+    Lift lifted;
+    lifted.handle(CallEvent{});
+    lifted.handle(CallEvent{});
+    lifted.handle(PowerCutEvent{});
+    lifted.handle(PowerOnEvent{});
+    lifted.handle(CallEvent{});
+    lifted.handle(ArriveEvent{});
+    if (WaitingState::entries != 2 || MovingState::entries != 2 || StoppedState::entries != 1)
     {
-        return static_string{""};
+        return 1;
     }
 
-    template<typename T>
-    constexpr auto operator()(state_machine::types<T> type) const
+    constexpr auto blob = sm::pack_transition_table(
+      SM::get_state_types(), sm::types<OpenEvent, CloseEvent, LockEvent, UnlockEvent>{});
+    const auto packed = sm::load_transition_table(blob);
+    if (!packed || packed->entries.size() != 12)
     {
-        return stringify(type);
+        return 1;
     }
-};
+    sm::write_dot(std::cout, *packed);
 
-template<std::size_t width>
-struct constant_width_stringifier
-{
-    constexpr auto operator()(state_machine::types<Header>) const
+    // The knock draws no edge and the choice a single one
+    constexpr auto latchBlob =
+      sm::pack_transition_table(sm::types<Unlatched, Latched>{}, sm::types<OpenEvent, CloseEvent>{});
+    const auto        latch = sm::load_transition_table(latchBlob);
+    std::stringstream latchDot;
+    if (latch)
     {
-        return static_string{""}.template change_length<width>(' ');
+        sm::write_dot(latchDot, *latch);
     }
-
-    template<typename T>
-    constexpr auto operator()(state_machine::types<T> type) const
+    if (!latch || latch->entries.size() != 4
+        || latchDot.str().find(" -> ") != latchDot.str().rfind(" -> ")
+        || latchDot.str().find("s0 -> s1") == std::string::npos
+        || latchDot.str().find("any") != std::string::npos)
     {
-        return stringify(type).template change_length<width>(' ');
+        return 1;
     }
-};
 
-template<typename Stringifier, typename State>
-class generate_row
-{
-  public:
-    constexpr generate_row(Stringifier str, state_machine::types<State>)
-      : str(str)
+    // A second target for a pair, as a maybe<one_of<...>> packs, does not
+    // fit a dynamic cell
+    auto forked = *packed;
+    forked.entries.push_back(forked.entries.back());
+    forked.entries.back().target = 1;
+    if (!sm::dynamic_table::from_packed(*packed) || sm::dynamic_table::from_packed(forked))
+    {
+        return 1;
+    }
+
+    // The same door, configured at run time from its printed table
+    auto doorTable = sm::dynamic_table::parse(
+      sm::generate_pretty_transition_table(SM::get_state_types(),
+                                           sm::types<OpenEvent, CloseEvent, LockEvent, UnlockEvent>{})
+        .data());
+    uint32_t doorKey = 1234;
+    auto     keyMatches = [](void* key, const sm::dynamic_machine&, const sm::dynamic_event& e) {
+        return static_cast<const UnlockEvent*>(e.payload)->key == *static_cast<uint32_t*>(key);
+    };
+    if (!doorTable || !doorTable->guard("LockedState", "UnlockEvent", keyMatches, &doorKey))
+    {
+        return 1;
+    }
+    sm::dynamic_machine dynamicDoor{*doorTable};
+    const UnlockEvent   wrongKey{2};
+    const UnlockEvent   rightKey{1234};
+    dynamicDoor.handle({*doorTable->event("LockEvent")});
+    dynamicDoor.handle({*doorTable->event("UnlockEvent"), &wrongKey});
+    const bool stayedLocked = dynamicDoor.current() == *doorTable->state("LockedState");
+    dynamicDoor.handle({*doorTable->event("UnlockEvent"), &rightKey});
+    if (!stayedLocked || dynamicDoor.current() != *doorTable->state("ClosedState"))
     {
+        return 1;
     }
 
-    constexpr auto operator()(state_machine::types<State> state) const
+    SM sm{ClosedState{}, OpenState{}, LockedState{0}};
+
     {
-        return str(state);
+        sm::journal_writer<OpenEvent, CloseEvent, LockEvent, UnlockEvent> journal{"demo.smjl"};
+        sm::journaled<SM, OpenEvent, CloseEvent, LockEvent, UnlockEvent> driver{sm, journal};
+        const bool handled = driver.handle(LockEvent{1234}) && driver.handle(UnlockEvent{2})
+                             && driver.handle(UnlockEvent{1234});
+        if (!handled || !journal.commit())
+        {
+            return 1;
+        }
     }
 
-    template<typename Event>
-    constexpr auto operator()(state_machine::types<Event>) const
+    // Events a failed journal cannot record do not reach the machine either
     {
-        auto action = state_machine::resolve_action{}(
-          state_machine::types<state_machine::types<State, Event>>{});
-        return static_string{" | "} + str(action);
-    }
+        SM unjournaled{ClosedState{}, OpenState{}, LockedState{0}};
 
-  private:
-    const Stringifier str;
-};
+        sm::journal_writer<OpenEvent, CloseEvent, LockEvent, UnlockEvent> journal{"missing/demo.smjl"};
+        sm::journaled<SM, OpenEvent, CloseEvent, LockEvent, UnlockEvent> driver{unjournaled, journal};
+        if (journal.good() || driver.handle(OpenEvent{}))
+        {
+            return 1;
+        }
+    }
 
-template<typename Stringifier>
-class generate_row<Stringifier, Header>
-{
-  public:
-    constexpr generate_row(Stringifier str, state_machine::types<Header>)
-      : str(str)
+    SM   replayed{ClosedState{}, OpenState{}, LockedState{0}};
+    auto replay = sm::replay_journal<OpenEvent, CloseEvent, LockEvent, UnlockEvent>("demo.smjl", replayed);
+    if (!replay.complete || replay.events != 3)
     {
+        return 1;
     }
 
-    constexpr auto operator()(state_machine::types<Header> header) const
+    // A crash in the middle of the last write leaves a torn record, which
+    // reopening cuts off so the next appends replay after it
+    std::filesystem::resize_file("demo.smjl", std::filesystem::file_size("demo.smjl") - 1);
     {
-        return str(header);
+        sm::journal_writer<OpenEvent, CloseEvent, LockEvent, UnlockEvent> journal{"demo.smjl"};
+        if (!journal.good() || !journal.append(UnlockEvent{1234}) || !journal.commit())
+        {
+            return 1;
+        }
     }
 
-    template<typename Event>
-    constexpr auto operator()(state_machine::types<Event> event) const
+    SM   recovered{ClosedState{}, OpenState{}, LockedState{0}};
+    auto reread = sm::replay_journal<OpenEvent, CloseEvent, LockEvent, UnlockEvent>("demo.smjl", recovered);
+    std::remove("demo.smjl");
+    if (!reread.complete || reread.events != 3)
     {
-        return static_string{" | "} + str(event);
+        return 1;
     }
 
-  private:
-    const Stringifier str;
-};
+    sm::virtual_clock clock;
+    sm::timer_wheel<sm::virtual_clock, OpenEvent, CloseEvent, LockEvent, UnlockEvent> timers{
+      clock, std::chrono::milliseconds(1)};
+    SM                                   door{ClosedState{}, OpenState{}, LockedState{0}};
+    sm::timed<SM, decltype(timers)>      timedDoor{door, timers, 0};
+    auto deliver = [&timedDoor](const auto* first, const auto* last) {
+        for (; first != last; ++first)
+        {
+            timedDoor.handle(first->second);
+        }
+    };
+    timedDoor.handle(OpenEvent{});
+    timedDoor.schedule(std::chrono::seconds(30), CloseEvent{});
+    const auto relock = timedDoor.schedule(std::chrono::seconds(60), LockEvent{99});
+    clock.advance(std::chrono::seconds(29));
+    const std::size_t early = timers.poll(deliver);
+    clock.advance(std::chrono::seconds(1));
+    const std::size_t onTime = timers.poll(deliver);
+    if (early != 0 || onTime != 1 || !timedDoor.cancel(relock) || timers.size() != 0)
+    {
+        return 1;
+    }
 
-template<typename Stringifier, typename... Events>
-class generate_table
-{
-  public:
-    constexpr generate_table(Stringifier str, sm::types<Events...>)
-      : str(str)
+    // Random schedules, cancels and clock jumps checked against a plain set
+    // of deadlines: every poll fires exactly the timers due, in deadline order
     {
+        std::mt19937_64                               random{2024};
+        sm::virtual_clock                             wheelClock;
+        sm::timer_wheel<sm::virtual_clock, OpenEvent> wheel{wheelClock, std::chrono::nanoseconds(1)};
+        std::vector<sm::timer_id>                     ids;
+        std::vector<uint64_t>                         deadlines;
+        std::set<std::pair<uint64_t, std::size_t>>    due;
+        auto ticks = [&wheelClock] { return uint64_t(wheelClock.now().time_since_epoch().count()); };
+
+        for (int round = 0; round < 20000; ++round)
+        {
+            for (auto n = random() % 4; n != 0; --n)
+            {
+                const int      scale = random() % 3;
+                const uint64_t range = scale == 0 ? 512 : scale == 1 ? 1u << 20 : 1ull << 34;
+                const uint64_t delay = 1 + random() % range;
+                deadlines.push_back(ticks() + delay);
+                due.emplace(deadlines.back(), ids.size());
+                ids.push_back(wheel.schedule(ids.size(), std::chrono::nanoseconds(delay), OpenEvent{}));
+            }
+            if (!ids.empty() && random() % 2 == 0)
+            {
+                const std::size_t id = random() % ids.size();
+                if (wheel.cancel(ids[id]) != (deadlines[id] != 0))
+                {
+                    return 1;
+                }
+                due.erase({deadlines[id], id});
+                deadlines[id] = 0;
+            }
+
+            wheelClock.advance(std::chrono::nanoseconds(random() % (1u << 26)));
+            bool     ordered = true;
+            uint64_t last    = 0;
+            wheel.poll([&](const auto* first, const auto* end) {
+                for (; first != end; ++first)
+                {
+                    const uint64_t deadline = deadlines[first->first];
+                    ordered                 = ordered && deadline != 0 && deadline >= last;
+                    due.erase({deadline, first->first});
+                    deadlines[first->first] = 0;
+                    last                    = deadline;
+                }
+            });
+            const bool early = !due.empty() && due.begin()->first <= ticks();
+            if (!ordered || last > ticks() || early || wheel.size() != due.size())
+            {
+                return 1;
+            }
+        }
     }
 
-    template<typename State>
-    constexpr auto operator()(sm::types<State> state) const
+    // A fleet hands out its instances only between runs, and runs once at a time
     {
-        return (sm::types<State, Events...>{} | sm::map_and_join{generate_row{str, state}})
-               + static_string{"\n"};
+        using Fleet = sm::sharded_runtime<SM, OpenEvent, CloseEvent, LockEvent, UnlockEvent>;
+        auto  make = [](std::size_t) { return SM{ClosedState{}, OpenState{}, LockedState{0}}; };
+        Fleet fleet{8, make, {2, 0, 64, false}};
+        const bool unbuilt = fleet.machine(3) == nullptr;
+        const bool started = fleet.start() && !fleet.start() && fleet.machine(3) == nullptr;
+        fleet.stop();
+        if (!unbuilt || !started || fleet.machine(3) == nullptr || fleet.machine(8) != nullptr)
+        {
+            return 1;
+        }
     }
 
-  private:
-    const Stringifier str;
-};
+    using Event = std::variant<OpenEvent, CloseEvent, LockEvent, UnlockEvent>;
+    const Event batch[] = {OpenEvent{}, CloseEvent{}, LockEvent{42}, UnlockEvent{42}};
+    sm::event_queue<SM, OpenEvent, CloseEvent, LockEvent, UnlockEvent> queue{sm};
+    queue.handle_batch(batch);
 
-template<std::size_t X>
-struct maximum
-{
-    template<std::size_t Y>
-    constexpr auto operator+(maximum<Y>) const
+    using SpringSM = sm::state_machine<SpringClosed, SpringOpen>;
+    SpringSM                                                                 spring;
+    sm::event_queue<SpringSM, OpenEvent, CloseEvent, LockEvent, UnlockEvent> springQueue{spring};
+    const Event pushes[] = {OpenEvent{}, OpenEvent{}, LockEvent{1}, OpenEvent{}};
+    springQueue.handle_batch(pushes);
+    if (SpringClosed::closings != 3)
     {
-        return maximum<std::max(X, Y)>{};
+        return 1;
+    }
+
+    using Pool = sm::machine_pool<ClosedState, OpenState, LockedState>;
+    Pool pool{1024, ClosedState{}, OpenState{}, LockedState{0}};
+    const Pool::batch_entry<OpenEvent, CloseEvent, LockEvent, UnlockEvent> steps[] = {
+      {1, LockEvent{7}}, {2, OpenEvent{}}, {1, UnlockEvent{7}}, {2, CloseEvent{}}};
+    pool.handle_batch(std::begin(steps), std::end(steps));
+
+    // Even a pool of states without data owns its state indices alone
+    using Doors = sm::machine_pool<ClosedState, OpenState>;
+    static_assert(!std::is_copy_constructible_v<Doors> && !std::is_copy_assignable_v<Doors>
+                    && std::is_move_constructible_v<Doors> && std::is_move_assignable_v<Doors>,
+                  "a copy would share the state indices of its source");
+
+    // Doors without locks only need their state: every step is a table lookup
+    sm::machine_pool<ClosedState, OpenState> doors{100};
+    uint8_t                                  codes[100];
+    uint64_t                                 fired[2];
+    for (std::size_t id = 0; id < doors.size(); ++id)
+    {
+        codes[id] = id % 3 == 0 ? 0 : 1; // OpenEvent or CloseEvent
     }
-
-    static constexpr auto value()
+    const std::size_t opened = sm::step_pool<OpenEvent, CloseEvent>(doors, codes, fired);
+    if (opened != 34 || doors.current_index(3) != 1 || doors.current_index(4) != 0
+        || (fired[0] & 0x9) != 0x9)
     {
-        return X;
+        return 1;
     }
-};
 
-struct calculate_max_length
-{
-    template<typename T>
-    constexpr auto operator()(sm::types<T> type)
+    using Snapshot = sm::pool_snapshot<ClosedState, OpenState, LockedState>;
+    if (!Snapshot::save(pool, "pool.smps"))
     {
-        return maximum<stringify(type).length()>{};
+        return 1;
+    }
+    auto restored = Snapshot::restore("pool.smps", ClosedState{}, OpenState{}, LockedState{0});
+    std::remove("pool.smps");
+    if (!restored || restored->size() != pool.size())
+    {
+        return 1;
+    }
+    for (std::size_t id = 0; id < pool.size(); ++id)
+    {
+        if (restored->current_index(id) != pool.current_index(id))
+        {
+            return 1;
+        }
     }
-};
 
-template<typename... StateTypes, typename... EventTypes>
-constexpr auto generate_transition_table(sm::types<StateTypes...> states,
-                                         sm::types<EventTypes...> events)
-{
-    constexpr simple_stringifier stringifier;
-    constexpr auto               result =
-      (sm::types<Header>{} + states) | sm::map_and_join{generate_table{stringifier, events}};
+    sm::basic_state_machine<table_policy, ClosedState, OpenState, LockedState> tsm{
+      ClosedState{}, OpenState{}, LockedState{0}};
 
-    return result;
-}
+    tsm.handle(LockEvent{1234});
+    tsm.handle(UnlockEvent{2});
+    tsm.handle(UnlockEvent{1234});
+    tsm.handle_batch(std::begin(batch), std::end(batch));
 
-template<typename... StateTypes, typename... EventTypes>
-constexpr auto generate_pretty_transition_table(sm::types<StateTypes...> states,
-                                                sm::types<EventTypes...> events)
-{
-    constexpr auto actions = (states * events) | sm::map_and_join(sm::resolve_action{});
-    constexpr auto max_width =
-      (states + events + actions) | sm::map_and_join(calculate_max_length{});
-    constexpr constant_width_stringifier<max_width.value()> stringifier{};
-    constexpr auto                                          result =
-      (sm::types<Header>{} + states) | sm::map_and_join{generate_table{stringifier, events}};
-
-    return result;
-}
+    sm::basic_state_machine<compact_policy, ClosedState, OpenState, LockedState> csm;
 
-int main()
-{
-    using SM = sm::state_machine<ClosedState, OpenState, LockedState>;
+    csm.handle(LockEvent{1234});
+    csm.handle(UnlockEvent{2});
+    csm.handle(UnlockEvent{1234});
 
-    std::cout << generate_transition_table(
-                   SM::get_state_types(),
-                   sm::types<OpenEvent, CloseEvent, LockEvent, UnlockEvent>{})
-                   .data()
-              << std::endl;
-    std::cout << generate_pretty_transition_table(
-                   SM::get_state_types(),
-                   sm::types<OpenEvent, CloseEvent, LockEvent, UnlockEvent>{})
-                   .data()
-              << std::endl;
+    using ProfiledSM = sm::basic_state_machine<profiled_policy, ClosedState, OpenState, LockedState>;
+    ProfiledSM psm{ClosedState{}, OpenState{}, LockedState{0}};
 
-    SM sm{ClosedState{}, OpenState{}, LockedState{0}};
+    psm.handle(LockEvent{1234});
+    psm.handle(UnlockEvent{2});
+    psm.handle(UnlockEvent{1234});
 
-    sm.handle(LockEvent{1234});
-    sm.handle(UnlockEvent{2});
-    sm.handle(UnlockEvent{1234});
+    sm::print_transition_stats<ProfiledSM>(std::cout);
 
     return 0;
 }
@@ -0,0 +1,432 @@
+#ifndef PACKED_TABLE_H
+#define PACKED_TABLE_H
+
+#include "analysis.h"
+#include "state_machine.h"
+#include "types/resolve.h"
+#include "types/types.h"
+#include "types/util.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace state_machine
+{
+
+// Packed transition table layout, all integers little-endian:
+//
+//   header   "SMTB", u8 version, u8 0, u16 states, u16 events, u16 0, u32 entries
+//   entries  u16 state, u16 event, u16 target, u8 action_kind, u8 0
+//   labels   state labels then event labels, each NUL-terminated
+//
+// Entries are sorted by state, then event. A pair whose action may lead to
+// several states has one entry per distinct target; a pair without a target
+// has a single entry with target no_target, and one whose action may lead to
+// any state a single entry with target any_state.
+enum class action_kind : std::uint8_t
+{
+    ignore,
+    transition,
+    maybe,
+    choice,
+    custom
+};
+
+constexpr std::uint16_t no_target      = 0xffff;
+constexpr std::uint16_t any_state      = 0xfffe;
+constexpr std::uint8_t  packed_version = 2;
+
+template<typename Action>
+constexpr action_kind kind(types<Action>)
+{
+    return action_kind::custom;
+}
+
+constexpr action_kind kind(types<nothing>)
+{
+    return action_kind::ignore;
+}
+
+template<typename State, typename Factory>
+constexpr action_kind kind(types<transition_to<State, Factory>>)
+{
+    return action_kind::transition;
+}
+
+template<typename... Actions>
+constexpr action_kind kind(types<one_of<Actions...>>)
+{
+    return action_kind::choice;
+}
+
+template<typename Action>
+constexpr action_kind kind(types<maybe<Action>>)
+{
+    return action_kind::maybe;
+}
+
+struct packed_entry
+{
+    std::uint16_t state;
+    std::uint16_t event;
+    std::uint16_t target;
+    action_kind   kind;
+};
+
+// Table read back from a packed blob
+struct packed_table
+{
+    std::vector<std::string>  states;
+    std::vector<std::string>  events;
+    std::vector<packed_entry> entries;
+};
+
+namespace detail
+{
+
+constexpr std::size_t packed_header_size = 16;
+constexpr std::size_t packed_entry_size  = 8;
+
+template<std::size_t N>
+class byte_writer
+{
+  public:
+    constexpr void u8(std::uint8_t value)
+    {
+        bytes[length++] = value;
+    }
+
+    constexpr void u16(std::uint16_t value)
+    {
+        u8(value & 0xff);
+        u8(value >> 8);
+    }
+
+    constexpr void u32(std::uint32_t value)
+    {
+        u16(value & 0xffff);
+        u16(value >> 16);
+    }
+
+    template<std::size_t M>
+    constexpr void label(const static_string<M>& text)
+    {
+        for (std::size_t i = 0; i <= text.length(); ++i)
+        {
+            u8(text.data()[i]);
+        }
+    }
+
+    constexpr std::array<std::uint8_t, N> data() const
+    {
+        return bytes;
+    }
+
+  private:
+    std::array<std::uint8_t, N> bytes{};
+    std::size_t                 length = 0;
+};
+
+template<typename State, typename Event>
+using packed_action = type_of_t<decltype(resolve_action{}(types<State, Event>{}))>;
+
+template<typename Target, typename... States>
+constexpr std::uint16_t target_index(types<States...> states)
+{
+    if constexpr (std::is_same_v<Target, any_target>)
+    {
+        return any_state;
+    }
+    else
+    {
+        constexpr std::size_t index = index_of<Target>(types<States...>{});
+        return index < size(states) ? index : no_target;
+    }
+}
+
+template<std::size_t N>
+struct target_set
+{
+    std::array<std::uint16_t, N> targets{};
+    std::size_t                  count = 0;
+};
+
+// Indices of the targets, each once, in the order they are first listed: a
+// one_of may name the same state twice
+template<typename... States, typename... Targets>
+constexpr auto distinct_targets(types<States...>, types<Targets...>)
+{
+    const std::array<std::uint16_t, sizeof...(Targets)> all{
+      target_index<Targets>(types<States...>{})...};
+
+    target_set<sizeof...(Targets)> result;
+    for (std::uint16_t target : all)
+    {
+        bool seen = false;
+        for (std::size_t i = 0; i < result.count; ++i)
+        {
+            seen = seen || result.targets[i] == target;
+        }
+        if (!seen)
+        {
+            result.targets[result.count++] = target;
+        }
+    }
+    return result;
+}
+
+template<typename State, typename Event, typename... States>
+constexpr std::size_t entry_count(types<State>, types<Event>, types<States...>)
+{
+    constexpr std::size_t count =
+      distinct_targets(types<States...>{}, targets(types<packed_action<State, Event>>{})).count;
+    return count == 0 ? 1 : count;
+}
+
+template<typename State, typename... States, typename... Events>
+constexpr std::size_t row_entry_count(types<State> state, types<States...> states, types<Events...>)
+{
+    return (std::size_t{0} + ... + entry_count(state, types<Events>{}, states));
+}
+
+template<std::size_t N, typename... States, typename... Targets>
+constexpr void write_entries(byte_writer<N>&  out,
+                             std::uint16_t    state,
+                             std::uint16_t    event,
+                             action_kind      kind,
+                             types<States...> states,
+                             types<Targets...> targets)
+{
+    auto entry = [&](std::uint16_t target) {
+        out.u16(state);
+        out.u16(event);
+        out.u16(target);
+        out.u8(static_cast<std::uint8_t>(kind));
+        out.u8(0);
+    };
+
+    const auto distinct = distinct_targets(states, targets);
+    if (distinct.count == 0)
+    {
+        entry(no_target);
+    }
+    for (std::size_t i = 0; i < distinct.count; ++i)
+    {
+        entry(distinct.targets[i]);
+    }
+}
+
+template<std::size_t N, typename State, typename... States, typename... Events>
+constexpr void write_row(byte_writer<N>& out,
+                         std::uint16_t   from,
+                         types<State>,
+                         types<States...> states,
+                         types<Events...>)
+{
+    std::uint16_t event = 0;
+    (write_entries(out,
+                   from,
+                   event++,
+                   kind(types<packed_action<State, Events>>{}),
+                   states,
+                   targets(types<packed_action<State, Events>>{})),
+     ...);
+}
+
+inline std::uint32_t read(const std::uint8_t* data, std::size_t bytes)
+{
+    std::uint32_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i)
+    {
+        value |= std::uint32_t{data[i]} << (8 * i);
+    }
+    return value;
+}
+
+} // namespace detail
+
+// Packs the (state, event) -> (action kind, target) table into a byte array
+// built at compile time, in the layout described above
+template<typename... StateTypes, typename... EventTypes>
+constexpr auto pack_transition_table(types<StateTypes...> states, types<EventTypes...> events)
+{
+    static_assert(sizeof...(StateTypes) < any_state && sizeof...(EventTypes) <= 0xffff,
+                  "state and event indices must fit in 16 bits");
+
+    constexpr std::size_t entries =
+      (std::size_t{0} + ... + detail::row_entry_count(types<StateTypes>{}, states, events));
+    constexpr std::size_t labels =
+      (std::size_t{0} + ... + (stringify(types<StateTypes>{}).length() + 1))
+      + (std::size_t{0} + ... + (stringify(types<EventTypes>{}).length() + 1));
+    constexpr std::size_t total =
+      detail::packed_header_size + entries * detail::packed_entry_size + labels;
+
+    detail::byte_writer<total> out;
+    for (char c : {'S', 'M', 'T', 'B'})
+    {
+        out.u8(c);
+    }
+    out.u8(packed_version);
+    out.u8(0);
+    out.u16(sizeof...(StateTypes));
+    out.u16(sizeof...(EventTypes));
+    out.u16(0);
+    out.u32(entries);
+
+    std::uint16_t from = 0;
+    (detail::write_row(out, from++, types<StateTypes>{}, states, events), ...);
+
+    (out.label(stringify(types<StateTypes>{})), ...);
+    (out.label(stringify(types<EventTypes>{})), ...);
+    return out.data();
+}
+
+// Reads a blob written by pack_transition_table; nullopt when it is
+// truncated, of another version or refers to states or events it lacks
+inline std::optional<packed_table> load_transition_table(const std::uint8_t* data, std::size_t size)
+{
+    using detail::read;
+
+    if (size < detail::packed_header_size || data[0] != 'S' || data[1] != 'M' || data[2] != 'T'
+        || data[3] != 'B' || data[4] != packed_version)
+    {
+        return std::nullopt;
+    }
+
+    const std::size_t states  = read(data + 6, 2);
+    const std::size_t events  = read(data + 8, 2);
+    const std::size_t entries = read(data + 12, 4);
+    if (entries > (size - detail::packed_header_size) / detail::packed_entry_size)
+    {
+        return std::nullopt;
+    }
+
+    packed_table table;
+    table.entries.reserve(entries);
+    const std::uint8_t* cursor = data + detail::packed_header_size;
+    for (std::size_t i = 0; i < entries; ++i, cursor += detail::packed_entry_size)
+    {
+        const packed_entry entry{static_cast<std::uint16_t>(read(cursor, 2)),
+                                 static_cast<std::uint16_t>(read(cursor + 2, 2)),
+                                 static_cast<std::uint16_t>(read(cursor + 4, 2)),
+                                 static_cast<action_kind>(cursor[6])};
+        if (entry.state >= states || entry.event >= events
+            || (entry.target >= states && entry.target != no_target && entry.target != any_state)
+            || cursor[6] > static_cast<std::uint8_t>(action_kind::custom))
+        {
+            return std::nullopt;
+        }
+        table.entries.push_back(entry);
+    }
+
+    const std::uint8_t* const end = data + size;
+    auto readLabels               = [&cursor, end](std::vector<std::string>& labels, std::size_t count) {
+        labels.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const std::uint8_t* label = cursor;
+            while (cursor != end && *cursor != '\0')
+            {
+                ++cursor;
+            }
+            if (cursor == end)
+            {
+                return false;
+            }
+            labels.emplace_back(label, cursor++);
+        }
+        return true;
+    };
+
+    if (!readLabels(table.states, states) || !readLabels(table.events, events))
+    {
+        return std::nullopt;
+    }
+    return table;
+}
+
+template<std::size_t N>
+std::optional<packed_table> load_transition_table(const std::array<std::uint8_t, N>& blob)
+{
+    return load_transition_table(blob.data(), blob.size());
+}
+
+namespace detail
+{
+
+inline std::string dot_quoted(const std::string& text)
+{
+    std::string result = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + '"';
+}
+
+} // namespace detail
+
+// Graphviz digraph with one node per state and one edge per entry that
+// leads somewhere. maybe edges are dashed, one_of edges dotted; actions
+// that may lead anywhere point at a shared "?" node.
+inline void write_dot(std::ostream& out, const packed_table& table)
+{
+    out << "digraph state_machine {\n";
+    for (std::size_t s = 0; s < table.states.size(); ++s)
+    {
+        out << "    s" << s << " [label=" << detail::dot_quoted(table.states[s]) << "];\n";
+    }
+
+    bool anyTarget = false;
+    for (const packed_entry& entry : table.entries)
+    {
+        if (entry.kind == action_kind::ignore || entry.target == no_target)
+        {
+            continue;
+        }
+
+        // Custom actions that declare no targets, on their own or inside
+        // maybe<> and one_of<>, may lead anywhere: their edges go to the
+        // "any" pseudo-node
+        out << "    s" << entry.state << " -> ";
+        if (entry.target == any_state)
+        {
+            anyTarget = true;
+            out << "any";
+        }
+        else
+        {
+            out << 's' << entry.target;
+        }
+        out << " [label=" << detail::dot_quoted(table.events[entry.event]);
+        if (entry.kind == action_kind::maybe)
+        {
+            out << ", style=dashed";
+        }
+        else if (entry.kind == action_kind::choice)
+        {
+            out << ", style=dotted";
+        }
+        out << "];\n";
+    }
+
+    if (anyTarget)
+    {
+        out << "    any [label=\"?\", shape=circle];\n";
+    }
+    out << "}\n";
+}
+
+} // namespace state_machine
+
+#endif // PACKED_TABLE_H
@@ -0,0 +1,293 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "types/types.h"
+#include "types/util.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace state_machine
+{
+
+template<typename... States>
+class pool_snapshot;
+
+// Struct-of-arrays storage for many independent machines over the same
+// states. The current state of every instance is a byte in one packed array
+// and each state type keeps its per-instance data in its own column; states
+// without data share a single object.
+//
+// The arrays are either owned by the pool or borrowed from a region such as
+// a mapped snapshot, which the pool then keeps alive.
+template<typename... States>
+class machine_pool
+{
+    static_assert(sizeof...(States) <= 256, "state index must fit in a byte");
+
+  public:
+    template<typename... Events>
+    using batch_entry = std::pair<std::size_t, std::variant<Events...>>;
+
+    explicit machine_pool(std::size_t count)
+      : machine_pool(count, States{}...)
+    {
+    }
+
+    machine_pool(std::size_t count, const States&... prototypes)
+      : indices(count, 0)
+      , current(indices.data())
+      , count(count)
+      , columns(column<States>(count, prototypes)...)
+    {
+    }
+
+    // The state indices may live in the pool's own buffer, which a copy
+    // would keep pointing into
+    machine_pool(const machine_pool&) = delete;
+    machine_pool& operator=(const machine_pool&) = delete;
+
+    machine_pool(machine_pool&&) = default;
+    machine_pool& operator=(machine_pool&&) = default;
+
+    std::size_t size() const
+    {
+        return count;
+    }
+
+    std::size_t current_index(std::size_t id) const
+    {
+        return current[id];
+    }
+
+    template<typename State>
+    State& get(std::size_t id)
+    {
+        return std::get<column<State>>(columns)[id];
+    }
+
+    // Packed state index of every instance, for engines stepping all of
+    // them at once (bulk.h)
+    std::uint8_t* state_indices()
+    {
+        return current;
+    }
+
+    template<typename Event>
+    void handle(std::size_t id, const Event& event)
+    {
+        handle(id, event, get_state_types(), std::make_index_sequence<sizeof...(States)>());
+    }
+
+    template<typename... Events>
+    void handle(std::size_t id, const std::variant<Events...>& event)
+    {
+        std::visit([this, id](const auto& e) { handle(id, e); }, event);
+    }
+
+    // Handles (instance id, event) pairs on up to `workers` threads. Instances
+    // are split into contiguous blocks, one per worker, so every instance is
+    // stepped by a single thread and sees its events in batch order.
+    // Worker threads are started by each call and joined before it returns,
+    // which costs tens of microseconds per worker: at least `grain` events
+    // go to every worker, and callers with small or frequent batches should
+    // pass workers = 1 or keep their own pool of threads.
+    template<typename... Events>
+    void handle_batch(const batch_entry<Events...>* first,
+                      const batch_entry<Events...>* last,
+                      unsigned                      workers = std::thread::hardware_concurrency())
+    {
+        const std::size_t count = last - first;
+        workers = std::max(1u, std::min<unsigned>(workers, (count + grain - 1) / grain));
+        if (workers == 1)
+        {
+            for (; first != last; ++first)
+            {
+                handle(first->first, first->second);
+            }
+            return;
+        }
+
+        // Stable counting sort of the batch by owning block
+        const std::size_t        block = round_up((size() + workers - 1) / workers);
+        std::vector<std::size_t> offsets(workers + 1, 0);
+        std::vector<std::size_t> order(count);
+        for (const auto* entry = first; entry != last; ++entry)
+        {
+            ++offsets[entry->first / block + 1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<std::size_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            order[cursor[first[i].first / block]++] = i;
+        }
+
+        auto step = [this, first, &order, &offsets](unsigned worker) {
+            for (std::size_t i = offsets[worker]; i < offsets[worker + 1]; ++i)
+            {
+                const auto& entry = first[order[i]];
+                handle(entry.first, entry.second);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned worker = 1; worker < workers; ++worker)
+        {
+            threads.emplace_back(step, worker);
+        }
+        step(0);
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    constexpr static types<States...> get_state_types()
+    {
+        return {};
+    }
+
+  private:
+    friend class pool_snapshot<States...>;
+
+    // Smallest batch worth handing to another thread
+    static constexpr std::size_t grain = 4096;
+
+    // Blocks of instances are padded to whole cache lines of state indices
+    static std::size_t round_up(std::size_t instances)
+    {
+        return (instances + 63) & ~std::size_t{63};
+    }
+
+    template<typename State, bool = std::is_empty_v<State>>
+    class column
+    {
+      public:
+        column(std::size_t count, const State& prototype)
+          : owned(count, prototype)
+          , values(owned.data())
+        {
+        }
+
+        column(State* borrowed, const State&)
+          : values(borrowed)
+        {
+        }
+
+        column(column&&) = default;
+        column& operator=(column&&) = default;
+
+        State& operator[](std::size_t id)
+        {
+            return values[id];
+        }
+
+        const State* data() const
+        {
+            return values;
+        }
+
+      private:
+        std::vector<State> owned;
+        State*             values;
+    };
+
+    template<typename State>
+    class column<State, true>
+    {
+      public:
+        column(std::size_t, const State& prototype)
+          : value(prototype)
+        {
+        }
+
+        column(State*, const State& prototype)
+          : value(prototype)
+        {
+        }
+
+        State& operator[](std::size_t)
+        {
+            return value;
+        }
+
+      private:
+        State value;
+    };
+
+    // Stands in for the machine while actions of one instance execute
+    class instance
+    {
+      public:
+        instance(machine_pool& pool, std::size_t id)
+          : pool(pool)
+          , id(id)
+        {
+        }
+
+        template<typename State, typename... Args>
+        State& transition(Args&&... args)
+        {
+            pool.current[id] = static_cast<std::uint8_t>(index_of<State>(get_state_types()));
+            State& state     = pool.template get<State>(id);
+            if constexpr (sizeof...(Args) != 0)
+            {
+                state = State(std::forward<Args>(args)...);
+            }
+            return state;
+        }
+
+      private:
+        machine_pool&     pool;
+        const std::size_t id;
+    };
+
+    template<typename Event, typename... Ts, std::size_t... Idx>
+    void handle(std::size_t id, const Event& event, types<Ts...>, std::index_sequence<Idx...>)
+    {
+        const std::size_t index = current[id];
+        (void)((index == Idx && (pass<Ts>(id, event), true)) || ...);
+    }
+
+    template<typename State, typename Event>
+    void pass(std::size_t id, const Event& event)
+    {
+        State&   state = get<State>(id);
+        instance machine{*this, id};
+        auto     action = state.handle(event);
+        action.execute(machine, state, event);
+    }
+
+    // Adopts state indices and columns living in `region`
+    machine_pool(std::shared_ptr<void> region,
+                 std::size_t           count,
+                 std::uint8_t*         current,
+                 std::pair<States*, const States&>... arrays)
+      : region(std::move(region))
+      , current(current)
+      , count(count)
+      , columns(column<States>(arrays.first, arrays.second)...)
+    {
+    }
+
+    std::shared_ptr<void>         region;
+    std::vector<std::uint8_t>     indices;
+    std::uint8_t*                 current;
+    std::size_t                   count;
+    std::tuple<column<States>...> columns;
+};
+
+} // namespace state_machine
+
+#endif // POOL_H
@@ -0,0 +1,498 @@
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace state_machine
+{
+
+namespace detail
+{
+
+constexpr std::size_t cache_line = 64;
+
+// Bounded single-producer/single-consumer ring. Each side keeps its own
+// position and a cached copy of the other side's on its own cache line, so
+// in steady state a push or a whole batch of pops touches shared lines once.
+template<typename T>
+class spsc_ring
+{
+  public:
+    // capacity is rounded up to a power of two
+    explicit spsc_ring(std::size_t capacity)
+      : mask(round_up(capacity) - 1)
+      , slots(new T[mask + 1])
+    {
+    }
+
+    // Producer side; false when the ring is full
+    template<typename U>
+    bool push(U&& value)
+    {
+        if (produced - headCache > mask)
+        {
+            headCache = head.load(std::memory_order_acquire);
+            if (produced - headCache > mask)
+            {
+                return false;
+            }
+        }
+        slots[produced & mask] = std::forward<U>(value);
+        tail.store(++produced, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: passes every published value to f, then frees their
+    // slots at once; returns how many there were
+    template<typename F>
+    std::size_t consume(F&& f)
+    {
+        const std::size_t last = tail.load(std::memory_order_acquire);
+        for (std::size_t pos = consumed; pos != last; ++pos)
+        {
+            f(slots[pos & mask]);
+        }
+        const std::size_t count = last - consumed;
+        if (count != 0)
+        {
+            consumed = last;
+            head.store(last, std::memory_order_release);
+        }
+        return count;
+    }
+
+  private:
+    static std::size_t round_up(std::size_t capacity)
+    {
+        std::size_t result = 1;
+        while (result < capacity)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const std::size_t    mask;
+    std::unique_ptr<T[]> slots;
+
+    alignas(cache_line) std::atomic<std::size_t> tail{0};
+    alignas(cache_line) std::atomic<std::size_t> head{0};
+    alignas(cache_line) std::size_t produced  = 0;
+    std::size_t headCache                     = 0;
+    alignas(cache_line) std::size_t consumed  = 0;
+};
+
+// Pins the calling thread to the slot-th CPU it is allowed to run on
+inline void pin_to_cpu(unsigned slot)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+    {
+        return;
+    }
+
+    unsigned skip = slot % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed) && skip-- == 0)
+        {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+            return;
+        }
+    }
+#else
+    (void)slot;
+#endif
+}
+
+} // namespace detail
+
+struct shard_stats
+{
+    // events handled by the shard's machines, and how many of them arrived
+    // from another shard or an external producer
+    std::uint64_t events = 0;
+    std::uint64_t remote = 0;
+    // drains that found events, and the events per such drain on average
+    std::uint64_t batches = 0;
+    // posts that found the destination queue full and had to wait
+    std::uint64_t stalls = 0;
+    // polls of the worker loop that found nothing to do
+    std::uint64_t idle = 0;
+};
+
+// Thread-per-core runtime for a fleet of machines. Instance id is owned by
+// shard id % shards; every shard has one worker thread, pinned to its own
+// core, which alone touches the shard's machines. Events reach a shard
+// through one SPSC ring per sender (every shard and every external
+// producer), so no queue has more than one writer and nothing is locked.
+//
+// Workers call an optional source, which produces events on the core that
+// received them (such as a socket served by that core): events for the
+// shard's own instances are handled in place, others are routed to their
+// owner. A sender blocked on a full ring keeps draining its own rings, so
+// shards sending to each other cannot deadlock. Actions get the machine
+// itself and do not post follow-up events through the runtime.
+//
+// Instances are constructed by their shard's worker on first start, so
+// their memory is local to the core that uses them; events must be
+// default-constructible.
+//
+// The workers run from start() to stop(). A running runtime is not started
+// again: start() then returns false. machine() reaches instances only while
+// the runtime is stopped after its first start, and returns nullptr
+// otherwise.
+template<typename Machine, typename... Events>
+class sharded_runtime
+{
+  public:
+    using event = std::variant<Events...>;
+
+    struct options
+    {
+        unsigned    shards    = std::max(1u, std::thread::hardware_concurrency());
+        unsigned    producers = 0; // external threads posting events
+        std::size_t capacity  = 4096;
+        bool        pin       = true;
+    };
+
+    class shard;
+
+    // Posting handle for one external thread
+    class producer
+    {
+      public:
+        // false when the owner's ring is full
+        template<typename Event>
+        bool post(std::size_t id, Event&& e)
+        {
+            return runtime.ring(row, runtime.owner(id)).push(entry{id, std::forward<Event>(e)});
+        }
+
+        template<typename Event>
+        void post_wait(std::size_t id, const Event& e)
+        {
+            while (!post(id, e))
+            {
+                std::this_thread::yield();
+            }
+        }
+
+      private:
+        friend class sharded_runtime;
+
+        producer(sharded_runtime& runtime, unsigned row)
+          : runtime(runtime)
+          , row(row)
+        {
+        }
+
+        sharded_runtime& runtime;
+        const unsigned   row;
+    };
+
+    // A shard as seen from its own worker, which is the only thread that may
+    // use it
+    class shard
+    {
+      public:
+        unsigned index() const
+        {
+            return self;
+        }
+
+        template<typename Event>
+        void post(std::size_t id, Event&& e)
+        {
+            const unsigned to = runtime.owner(id);
+            if (to == self)
+            {
+                handle(id, e);
+                bump(counters.events);
+                return;
+            }
+
+            auto& target = runtime.ring(self, to);
+            if (!target.push(entry{id, e}))
+            {
+                bump(counters.stalls);
+                while (!target.push(entry{id, e}))
+                {
+                    drain();
+                }
+            }
+        }
+
+        // Handles every event that reached the shard so far
+        std::size_t drain()
+        {
+            std::size_t handled = 0;
+            for (unsigned row = 0; row < runtime.rows; ++row)
+            {
+                handled += runtime.ring(row, self).consume([this](entry& next) {
+                    std::visit([this, &next](const auto& e) { handle(next.id, e); }, next.payload);
+                });
+            }
+            if (handled != 0)
+            {
+                bump(counters.events, handled);
+                bump(counters.remote, handled);
+                bump(counters.batches);
+            }
+            return handled;
+        }
+
+        Machine& local(std::size_t id)
+        {
+            return machines[id / runtime.shards];
+        }
+
+        shard_stats stats() const
+        {
+            return {counters.events.load(std::memory_order_relaxed),
+                    counters.remote.load(std::memory_order_relaxed),
+                    counters.batches.load(std::memory_order_relaxed),
+                    counters.stalls.load(std::memory_order_relaxed),
+                    counters.idle.load(std::memory_order_relaxed)};
+        }
+
+      private:
+        friend class sharded_runtime;
+
+        // Written by the worker only, read by anyone
+        struct alignas(detail::cache_line) counter_set
+        {
+            std::atomic<std::uint64_t> events{0};
+            std::atomic<std::uint64_t> remote{0};
+            std::atomic<std::uint64_t> batches{0};
+            std::atomic<std::uint64_t> stalls{0};
+            std::atomic<std::uint64_t> idle{0};
+        };
+
+        shard(sharded_runtime& runtime, unsigned self)
+          : runtime(runtime)
+          , self(self)
+        {
+        }
+
+        static void bump(std::atomic<std::uint64_t>& counter, std::uint64_t by = 1)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+
+        template<typename Event>
+        void handle(std::size_t id, const Event& e)
+        {
+            local(id).handle(e);
+        }
+
+        sharded_runtime&     runtime;
+        const unsigned       self;
+        std::vector<Machine> machines;
+        counter_set          counters;
+    };
+
+    // factory(id) makes instance id
+    template<typename Factory>
+    sharded_runtime(std::size_t instances, Factory factory, options config = {})
+      : instances(instances)
+      , shards(std::max(1u, config.shards))
+      , rows(shards + config.producers)
+      , pin(config.pin)
+      , make(std::move(factory))
+    {
+        rings.reserve(std::size_t{rows} * shards);
+        for (std::size_t i = 0; i < std::size_t{rows} * shards; ++i)
+        {
+            rings.push_back(std::make_unique<ring_type>(config.capacity));
+        }
+        for (unsigned i = 0; i < shards; ++i)
+        {
+            slices.emplace_back(new shard(*this, i));
+        }
+        for (unsigned i = 0; i < config.producers; ++i)
+        {
+            external.emplace_back(new producer(*this, shards + i));
+        }
+    }
+
+    sharded_runtime(const sharded_runtime&) = delete;
+    sharded_runtime& operator=(const sharded_runtime&) = delete;
+
+    ~sharded_runtime()
+    {
+        stop();
+    }
+
+    unsigned shard_count() const
+    {
+        return shards;
+    }
+
+    unsigned owner(std::size_t id) const
+    {
+        return static_cast<unsigned>(id % shards);
+    }
+
+    producer& external_producer(unsigned index)
+    {
+        return *external[index];
+    }
+
+    // Starts the workers. Each calls source(shard&) between drains while it
+    // returns true, meaning it has more to produce. false, with nothing
+    // started, when the workers already run.
+    template<typename Source>
+    bool start(Source source)
+    {
+        if (!workers.empty())
+        {
+            return false;
+        }
+
+        stopping.store(false, std::memory_order_relaxed);
+        sourced.store(0, std::memory_order_relaxed);
+        for (unsigned i = 0; i < shards; ++i)
+        {
+            workers.emplace_back([this, i, source]() mutable { work(*slices[i], source); });
+        }
+        return true;
+    }
+
+    bool start()
+    {
+        return start([](shard&) { return false; });
+    }
+
+    // Returns once every source is exhausted and every event posted before
+    // the call has been handled
+    void stop()
+    {
+        stopping.store(true, std::memory_order_release);
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    shard_stats stats(unsigned index) const
+    {
+        return slices[index]->stats();
+    }
+
+    // Instance id, or nullptr while the workers run, before the first
+    // start() has constructed the instances, or for an unknown id
+    Machine* machine(std::size_t id)
+    {
+        shard& owning = *slices[owner(id)];
+        if (!workers.empty() || id >= instances || owning.machines.empty())
+        {
+            return nullptr;
+        }
+        return &owning.local(id);
+    }
+
+  private:
+    struct entry
+    {
+        std::size_t id = 0;
+        event       payload;
+    };
+
+    using ring_type = detail::spsc_ring<entry>;
+
+    ring_type& ring(unsigned from, unsigned to)
+    {
+        return *rings[std::size_t{from} * shards + to];
+    }
+
+    template<typename Source>
+    void work(shard& self, Source& source)
+    {
+        constexpr unsigned spinLimit = 64;
+
+        if (pin)
+        {
+            detail::pin_to_cpu(self.self);
+        }
+        if (self.machines.empty())
+        {
+            for (std::size_t id = self.self; id < instances; id += shards)
+            {
+                self.machines.push_back(make(id));
+            }
+        }
+
+        bool     producing = true;
+        unsigned idle      = 0;
+        for (;;)
+        {
+            const std::size_t handled = self.drain();
+            if (producing)
+            {
+                producing = source(self);
+                if (!producing)
+                {
+                    sourced.fetch_add(1, std::memory_order_release);
+                }
+            }
+            else if (handled != 0)
+            {
+                idle = 0;
+            }
+            else if (stopping.load(std::memory_order_acquire)
+                     && sourced.load(std::memory_order_acquire) == shards)
+            {
+                // No one posts anymore; what is left in the rings is final
+                while (self.drain() != 0)
+                {
+                }
+                return;
+            }
+            else
+            {
+                shard::bump(self.counters.idle);
+                if (++idle > spinLimit)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    const std::size_t                        instances;
+    const unsigned                           shards;
+    const unsigned                           rows;
+    const bool                               pin;
+    std::function<Machine(std::size_t)>      make;
+    std::vector<std::unique_ptr<ring_type>>  rings;
+    std::vector<std::unique_ptr<shard>>      slices;
+    std::vector<std::unique_ptr<producer>>   external;
+    std::vector<std::thread>                 workers;
+    alignas(detail::cache_line) std::atomic<bool> stopping{false};
+    alignas(detail::cache_line) std::atomic<unsigned> sourced{0};
+};
+
+} // namespace state_machine
+
+#endif // SHARDED_H
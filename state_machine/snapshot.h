@@ -0,0 +1,275 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace state_machine
+{
+
+// Snapshot of a machine_pool in a file laid out for mapping:
+//
+//   header   64 bytes, see snapshot_header
+//   indices  one byte per instance: its current state
+//   columns  one array per state with data, in state order, each starting
+//            on a 64-byte boundary
+//
+// Integers are in native byte order and the layout fingerprint only covers
+// sizes and alignments of the states, so a snapshot is meant to be restored
+// by the same build on the same host. Restoring maps the file privately and
+// the pool works on the mapping directly: pages are read in on first use and
+// copied only when an instance changes, and the file itself is never
+// written.
+struct snapshot_header
+{
+    char          magic[4];
+    std::uint32_t version;
+    std::uint32_t states;
+    std::uint32_t reserved;
+    std::uint64_t instances;
+    std::uint64_t layout;
+    std::uint8_t  padding[32];
+};
+
+static_assert(sizeof(snapshot_header) == 64);
+
+constexpr std::uint32_t snapshot_version = 1;
+
+template<typename... States>
+class pool_snapshot
+{
+    static_assert(((std::is_empty_v<States> || std::is_trivially_copyable_v<States>) && ...),
+                  "states with data must be trivially copyable to be snapshotted");
+    static_assert(((alignof(States) <= 64) && ...), "state columns are 64-byte aligned");
+
+  public:
+    using pool_type = machine_pool<States...>;
+
+    // Writes the pool next to path and renames it into place, so a crash
+    // leaves either the old snapshot or the new one. The directory is synced
+    // after the rename, so once this returns true the new snapshot survives
+    // a crash; on failure the temporary file is removed.
+    static bool save(const pool_type& pool, const char* path)
+    {
+        const auto        offsets = layout_offsets(pool.size());
+        const std::string temporary = std::string(path) + ".tmp";
+
+        const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        snapshot_header header{};
+        std::memcpy(header.magic, "SMPS", 4);
+        header.version   = snapshot_version;
+        header.states    = sizeof...(States);
+        header.instances = pool.size();
+        header.layout    = layout();
+
+        std::size_t state = 0;
+        bool        ok    = ::ftruncate(fd, offsets.back()) == 0
+                   && write_all(fd, &header, sizeof(header), 0)
+                   && write_all(fd, pool.current, pool.size(), sizeof(header))
+                   && (write_column<States>(fd, pool, offsets[state++]) && ...);
+        ok = ::fsync(fd) == 0 && ok;
+        ok = ::close(fd) == 0 && ok;
+        if (!ok || std::rename(temporary.c_str(), path) != 0)
+        {
+            ::unlink(temporary.c_str());
+            return false;
+        }
+        return sync_directory(path);
+    }
+
+    // Maps the snapshot and checks its header, size and state indices.
+    // States without data are taken from the prototypes.
+    static std::optional<pool_type> restore(const char* path, const States&... prototypes)
+    {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            return std::nullopt;
+        }
+
+        struct stat info;
+        void*       base = MAP_FAILED;
+        if (::fstat(fd, &info) == 0 && std::size_t(info.st_size) >= sizeof(snapshot_header))
+        {
+            base = ::mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (base == MAP_FAILED)
+        {
+            return std::nullopt;
+        }
+
+        const std::size_t     length = info.st_size;
+        std::shared_ptr<void> region(base, [length](void* p) { ::munmap(p, length); });
+        auto* const           bytes = static_cast<std::uint8_t*>(base);
+
+        snapshot_header header;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (std::memcmp(header.magic, "SMPS", 4) != 0 || header.version != snapshot_version
+            || header.states != sizeof...(States) || header.layout != layout()
+            || header.instances > length)
+        {
+            return std::nullopt;
+        }
+
+        const auto offsets = layout_offsets(header.instances);
+        if (offsets.back() > length)
+        {
+            return std::nullopt;
+        }
+
+        std::uint8_t* const current = bytes + sizeof(header);
+        if (std::any_of(current, current + header.instances, [](std::uint8_t index) {
+                return index >= sizeof...(States);
+            }))
+        {
+            return std::nullopt;
+        }
+
+        return adopt(std::move(region),
+                     header.instances,
+                     current,
+                     bytes,
+                     offsets,
+                     std::index_sequence_for<States...>(),
+                     prototypes...);
+    }
+
+    static std::optional<pool_type> restore(const char* path)
+    {
+        return restore(path, States{}...);
+    }
+
+  private:
+    // Makes the last rename in the directory holding path durable
+    static bool sync_directory(const char* path)
+    {
+        const char*       slash  = std::strrchr(path, '/');
+        const std::size_t length = slash == nullptr ? 0 : std::max<std::size_t>(slash - path, 1);
+        const std::string directory = slash == nullptr ? std::string(".") : std::string(path, length);
+
+        const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        const bool ok = ::fsync(fd) == 0;
+        return ::close(fd) == 0 && ok;
+    }
+
+    static constexpr std::size_t align(std::size_t offset)
+    {
+        return (offset + 63) & ~std::size_t{63};
+    }
+
+    // Start of every state column (unused for states without data) and, at
+    // the back, the file size
+    static constexpr std::array<std::size_t, sizeof...(States) + 1> layout_offsets(
+      std::size_t instances)
+    {
+        std::array<std::size_t, sizeof...(States) + 1> offsets{};
+        std::size_t                                    end   = sizeof(snapshot_header) + instances;
+        std::size_t                                    state = 0;
+        ((offsets[state++] = std::is_empty_v<States> ? end : (end = align(end)),
+          end += std::is_empty_v<States> ? 0 : instances * sizeof(States)),
+         ...);
+        offsets.back() = end;
+        return offsets;
+    }
+
+    // FNV-1a over the size and alignment of every state
+    static constexpr std::uint64_t layout()
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::size_t value : {std::is_empty_v<States> ? 0 : sizeof(States)..., alignof(States)...})
+        {
+            hash = (hash ^ value) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    template<std::size_t... Idx>
+    static pool_type adopt(std::shared_ptr<void>                                 region,
+                           std::size_t                                           instances,
+                           std::uint8_t*                                         current,
+                           std::uint8_t*                                         bytes,
+                           const std::array<std::size_t, sizeof...(States) + 1>& offsets,
+                           std::index_sequence<Idx...>,
+                           const States&... prototypes)
+    {
+        return pool_type(std::move(region),
+                         instances,
+                         current,
+                         std::pair<States*, const States&>{column_at<States>(bytes, offsets[Idx]),
+                                                           prototypes}...);
+    }
+
+    template<typename State>
+    static State* column_at(std::uint8_t* bytes, std::size_t offset)
+    {
+        if constexpr (std::is_empty_v<State>)
+        {
+            return nullptr;
+        }
+        else
+        {
+            return reinterpret_cast<State*>(bytes + offset);
+        }
+    }
+
+    template<typename State>
+    static bool write_column(int fd, const pool_type& pool, std::size_t offset)
+    {
+        if constexpr (std::is_empty_v<State>)
+        {
+            return true;
+        }
+        else
+        {
+            const auto& column = std::get<typename pool_type::template column<State>>(pool.columns);
+            return write_all(fd, column.data(), pool.size() * sizeof(State), offset);
+        }
+    }
+
+    static bool write_all(int fd, const void* data, std::size_t size, std::size_t offset)
+    {
+        const char* cursor = static_cast<const char*>(data);
+        while (size != 0)
+        {
+            const ssize_t written = ::pwrite(fd, cursor, size, offset);
+            if (written <= 0)
+            {
+                return false;
+            }
+            cursor += written;
+            offset += written;
+            size -= written;
+        }
+        return true;
+    }
+};
+
+} // namespace state_machine
+
+#endif // SNAPSHOT_H
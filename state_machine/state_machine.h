@@ -0,0 +1,473 @@
+#ifndef STATE_MACHINE_H
+#define STATE_MACHINE_H
+
+#include "dispatch.h"
+#include "instrumentation.h"
+#include "storage.h"
+#include "types/types.h"
+#include "util/static_string.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#define STRINGIFY_IMPL(TYPE)                                                     \
+    [[maybe_unused]] static constexpr auto stringify(state_machine::types<TYPE>) \
+    {                                                                            \
+        return static_string{#TYPE};                                             \
+    }
+
+namespace state_machine
+{
+
+template<typename Event, typename Action>
+struct on
+{
+    Action handle(const Event&) const
+    {
+        return Action{};
+    }
+};
+
+struct default_policy
+{
+    using dispatch        = visit_dispatch;
+    using instrumentation = no_instrumentation;
+
+    template<typename... States>
+    using storage = tuple_storage<States...>;
+};
+
+template<typename Policy, typename... States>
+class basic_state_machine
+{
+    using dispatch        = typename Policy::dispatch;
+    using storage_type    = typename Policy::template storage<States...>;
+    using instrumentation = typename Policy::instrumentation;
+    friend dispatch;
+
+  public:
+    using policy = Policy;
+
+    basic_state_machine() = default;
+
+    template<typename... Args,
+             typename = std::enable_if_t<std::is_constructible_v<storage_type, Args&&...>>>
+    basic_state_machine(Args&&... args)
+      : storage(std::forward<Args>(args)...)
+    {
+    }
+
+    // Makes State current. With arguments, the state is (re)constructed from
+    // them; otherwise the storage policy decides whether it is kept as is.
+    template<typename State, typename... Args>
+    State& transition(Args&&... args)
+    {
+        return storage.template transition<State>(std::forward<Args>(args)...);
+    }
+
+    template<typename Event>
+    void handle(const Event& event)
+    {
+        handle_by(event, *this);
+    }
+
+    template<typename Event, typename Machine>
+    void handle_by(const Event& event, Machine& machine)
+    {
+        dispatch::handle(*this, machine, event);
+    }
+
+    // Runs of events that keep the state share one state lookup. A run
+    // broken by its first event shows a stream that changes state at almost
+    // every step, where the run checks only add cost, so the following
+    // events are handled one at a time, as by handle, until a few in a row
+    // keep the state again.
+    template<typename... Events>
+    void handle_batch(const std::variant<Events...>* first, const std::variant<Events...>* last)
+    {
+        while (first != last)
+        {
+            const auto* next = handle_batch_by(first, last, *this);
+            first            = next == first + 1 ? handle_each(next, last) : next;
+        }
+    }
+
+    // Passes events from the non-empty range [first, last) to the current
+    // state, looked up once for the whole run, through the dispatch policy
+    // as handle_by does. Stops after the first event that changes the state
+    // or leaves follow-up events pending in the machine; returns the
+    // position of the next unprocessed event.
+    template<typename... Events, typename Machine>
+    const std::variant<Events...>* handle_batch_by(const std::variant<Events...>* first,
+                                                   const std::variant<Events...>* last,
+                                                   Machine&                       machine)
+    {
+        auto passEventsToState = [this, &first, last, &machine](auto& state) {
+            auto passEventToState = [this, &machine, &state](const auto& event) {
+                dispatch::pass(*this, state, machine, event);
+            };
+
+            const std::size_t index = storage.index();
+            do
+            {
+                std::visit(passEventToState, *first++);
+            } while (first != last && storage.index() == index && !has_pending(&machine));
+        };
+
+        storage.visit(passEventsToState);
+        return first;
+    }
+
+    constexpr static types<States...> get_state_types()
+    {
+        return {};
+    }
+
+  private:
+    // Handles events from [first, last) one at a time until run_probe of
+    // them in a row keep the state; returns the next unprocessed one
+    template<typename... Events>
+    const std::variant<Events...>* handle_each(const std::variant<Events...>* first,
+                                               const std::variant<Events...>* last)
+    {
+        auto passToMachine = [this](const auto& event) {
+            handle(event);
+        };
+
+        std::size_t index = storage.index();
+        for (unsigned kept = 0; first != last && kept != run_probe;)
+        {
+            std::visit(passToMachine, *first++);
+            const std::size_t reached = storage.index();
+            kept                      = reached == index ? kept + 1 : 0;
+            index                     = reached;
+        }
+        return first;
+    }
+
+    // Events in a row that must keep the state before handle_batch goes
+    // back to runs. Synthetic machines with 16 events keep it about once in
+    // eight; two in a row still sent random streams back too often.
+    static constexpr unsigned run_probe = 4;
+
+    template<typename State>
+    State& get()
+    {
+        return storage.template get<State>();
+    }
+
+    template<typename State, typename Machine, typename Event>
+    void pass(State& state, Machine& machine, const Event& event)
+    {
+        if constexpr (instrumentation::enabled)
+        {
+            profile(state, machine, event);
+        }
+        else
+        {
+            auto action = state.handle(event);
+            action.execute(machine, state, event);
+        }
+    }
+
+    template<typename State, typename Machine, typename Event>
+    void profile(State& state, Machine& machine, const Event& event)
+    {
+        using clock = std::chrono::steady_clock;
+
+        constexpr auto        events     = typename instrumentation::events{};
+        constexpr std::size_t eventIndex = index_of<Event>(events);
+
+        if constexpr (eventIndex == size(events))
+        {
+            auto action = state.handle(event);
+            action.execute(machine, state, event);
+        }
+        else
+        {
+            const auto start   = clock::now();
+            auto       action  = state.handle(event);
+            const auto handled = clock::now();
+            action.execute(machine, state, event);
+            const auto executed = clock::now();
+
+            machine_stats<basic_state_machine>::record(
+              index_of<State>(get_state_types()),
+              eventIndex,
+              std::chrono::duration_cast<std::chrono::nanoseconds>(handled - start).count(),
+              std::chrono::duration_cast<std::chrono::nanoseconds>(executed - handled).count());
+        }
+    }
+
+    static bool has_pending(const void*)
+    {
+        return false;
+    }
+
+    template<typename Machine>
+    static auto has_pending(const Machine* machine) -> decltype(machine->has_pending())
+    {
+        return machine->has_pending();
+    }
+
+    storage_type storage;
+};
+
+template<typename... States>
+using state_machine = basic_state_machine<default_policy, States...>;
+
+// Composite states name the substate a transition to them enters with a
+// nested `initial` type; any other state is entered as is.
+template<typename State, typename = void>
+struct entry_state
+{
+    using type = State;
+};
+
+template<typename State>
+struct entry_state<State, std::void_t<typename State::initial>>
+  : entry_state<typename State::initial>
+{
+};
+
+template<typename State>
+using entry_state_t = typename entry_state<State>::type;
+
+// With a Factory, the new state is constructed from Factory{}(event);
+// otherwise the storage policy keeps or default-constructs it.
+template<typename TargetState, typename Factory = void>
+struct transition_to
+{
+    template<typename Machine, typename State, typename Event>
+    void execute(Machine& machine, State& prevState, const Event& event)
+    {
+        leave(prevState, event);
+        auto& newState = create(machine, event);
+        enter(newState, event);
+    }
+
+  private:
+    // The entry state is looked up only here, once TargetState is complete
+    template<typename Machine, typename Event>
+    auto& create(Machine& machine, const Event& event)
+    {
+        using Target = entry_state_t<TargetState>;
+        if constexpr (std::is_void_v<Factory>)
+        {
+            return machine.template transition<Target>();
+        }
+        else
+        {
+            return machine.template transition<Target>(Factory{}(event));
+        }
+    }
+
+    void leave(...) {}
+
+    template<typename State, typename Event>
+    auto leave(State& state, const Event& event) -> decltype(state.on_leave(event))
+    {
+        return state.on_leave(event);
+    }
+
+    void enter(...) {}
+
+    template<typename State, typename Event>
+    auto enter(State& state, const Event& event) -> decltype(state.on_enter(event))
+    {
+        return state.on_enter(event);
+    }
+};
+
+// Factory constructing the target state from the triggering event
+template<typename State>
+struct from_event
+{
+    template<typename Event>
+    State operator()(const Event& event) const
+    {
+        return State(event);
+    }
+};
+
+template<typename State, typename Factory>
+static constexpr auto stringify(types<transition_to<State, Factory>>)
+{
+    return static_string{"transition_to<"} + stringify(types<State>{}) + static_string{">"};
+}
+
+struct nothing
+{
+    template<typename Machine, typename State, typename Event>
+    void execute(Machine&, State&, const Event&)
+    {
+    }
+};
+
+static constexpr auto stringify(types<nothing>)
+{
+    return static_string{"nothing"};
+}
+
+namespace detail
+{
+
+// Actions without state are all alike, so a choice among them only needs
+// to remember which one was chosen
+template<typename... Actions>
+constexpr bool stateless_actions_v =
+  sizeof...(Actions) <= 256
+  && ((std::is_empty_v<Actions> && std::is_trivially_default_constructible_v<Actions>) && ...);
+
+template<bool Stateless, typename... Actions>
+class action_choice;
+
+// Keeps the chosen action itself and executes it through std::visit
+template<typename... Actions>
+class action_choice<false, Actions...>
+{
+  public:
+    template<typename T>
+    action_choice(T&& arg)
+      : options(std::forward<T>(arg))
+    {
+    }
+
+    template<typename Machine, typename State, typename Event>
+    void execute(Machine& machine, State& state, const Event& event)
+    {
+        std::visit(
+          [&machine, &state, &event](auto& action) {
+              action.execute(machine, state, event);
+          },
+          options);
+    }
+
+  private:
+    std::variant<Actions...> options;
+};
+
+// Keeps only the index of the chosen action and executes a fresh instance
+// of it from a chain of index comparisons, which the compiler lowers to a
+// switch (a single test for maybe); no variant is built or visited
+template<typename... Actions>
+class action_choice<true, Actions...>
+{
+  public:
+    // The alternative is picked by the same rules as the variant's
+    // converting constructor; with empty alternatives this folds away
+    template<typename T>
+    action_choice(T&& arg)
+      : index(static_cast<std::uint8_t>(std::variant<Actions...>(std::forward<T>(arg)).index()))
+    {
+    }
+
+    template<typename Machine, typename State, typename Event>
+    void execute(Machine& machine, State& state, const Event& event)
+    {
+        execute(std::index_sequence_for<Actions...>(), machine, state, event);
+    }
+
+  private:
+    template<std::size_t... Idx, typename Machine, typename State, typename Event>
+    void execute(std::index_sequence<Idx...>, Machine& machine, State& state, const Event& event)
+    {
+        ((index == Idx && (Actions{}.execute(machine, state, event), true)) || ...);
+    }
+
+    std::uint8_t index;
+};
+
+} // namespace detail
+
+// One of several actions chosen at run time. When every action is
+// stateless, only the index of the chosen one is kept.
+template<typename... Actions>
+struct one_of : detail::action_choice<detail::stateless_actions_v<Actions...>, Actions...>
+{
+    using detail::action_choice<detail::stateless_actions_v<Actions...>, Actions...>::action_choice;
+};
+
+template<typename Action>
+struct maybe : public one_of<Action, nothing>
+{
+    using one_of<Action, nothing>::one_of;
+};
+
+template<typename Action>
+static constexpr auto stringify(types<maybe<Action>>)
+{
+    return static_string{"maybe<"} + stringify(types<Action>{}) + static_string{">"};
+}
+
+template<typename Action>
+struct by_default
+{
+    template<typename Event>
+    Action handle(const Event&) const
+    {
+        return Action{};
+    }
+};
+
+template<typename... Handlers>
+struct will : Handlers...
+{
+    using Handlers::handle...;
+};
+
+template<typename Handler, typename Event, typename = void>
+struct can_handle : std::false_type
+{
+};
+
+template<typename Handler, typename Event>
+struct can_handle<
+  Handler,
+  Event,
+  std::void_t<decltype(std::declval<Handler&>().handle(std::declval<const Event&>()))>>
+  : std::true_type
+{
+};
+
+// Substate of the composite state Parent. Events its own Handlers do not
+// accept fall back to Parent's handlers, resolved at compile time, so the
+// hierarchy adds no dispatch cost. Parents only contribute handlers: they
+// are default-constructed to resolve the action and are never stored in
+// the machine.
+//
+// A handle overload declared in the derived state hides in::handle, like
+// any member of a base class; the state keeps the fallback by bringing it
+// back into scope:
+//
+//   struct Moving : in<Running, on<Arrive, transition_to<Waiting>>>
+//   {
+//       using in<Running, on<Arrive, transition_to<Waiting>>>::handle;
+//
+//       nothing handle(const Call&);
+//   };
+template<typename Parent, typename... Handlers>
+struct in : will<Handlers...>
+{
+    template<typename Event>
+    decltype(auto) handle(const Event& event)
+    {
+        if constexpr (can_handle<will<Handlers...>, Event>::value)
+        {
+            return will<Handlers...>::handle(event);
+        }
+        else
+        {
+            return Parent{}.handle(event);
+        }
+    }
+};
+
+} // namespace state_machine
+
+#endif // STATE_MACHINE_H
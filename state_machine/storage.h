@@ -0,0 +1,107 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace state_machine
+{
+
+// Every state is constructed up front and lives as long as the machine;
+// transitions only move the current state pointer, so references to states
+// stay valid.
+template<typename... States>
+class tuple_storage
+{
+  public:
+    tuple_storage() = default;
+    tuple_storage(States... states)
+      : states(std::move(states)...)
+    {
+    }
+
+    std::size_t index() const
+    {
+        return currentState.index();
+    }
+
+    template<typename State>
+    State& get()
+    {
+        return std::get<State>(states);
+    }
+
+    template<typename Visitor>
+    decltype(auto) visit(Visitor&& visitor)
+    {
+        return std::visit([&visitor](auto statePtr) -> decltype(auto) { return visitor(*statePtr); },
+                          currentState);
+    }
+
+    // The stored state is kept as is unless a new value is given
+    template<typename State, typename... Args>
+    State& transition(Args&&... args)
+    {
+        State& state = std::get<State>(states);
+        if constexpr (sizeof...(Args) != 0)
+        {
+            state = State(std::forward<Args>(args)...);
+        }
+        currentState = &state;
+        return state;
+    }
+
+  private:
+    std::tuple<States...>    states;
+    std::variant<States*...> currentState{&std::get<0>(states)};
+};
+
+// Only the current state is alive: a transition destroys the old state and
+// constructs the new one in its place, so the machine is as large as its
+// largest state.
+template<typename... States>
+class variant_storage
+{
+  public:
+    variant_storage() = default;
+
+    template<typename State,
+             typename = std::enable_if_t<std::disjunction_v<std::is_same<State, States>...>>>
+    variant_storage(State initial)
+      : current(std::move(initial))
+    {
+    }
+
+    std::size_t index() const
+    {
+        return current.index();
+    }
+
+    template<typename State>
+    State& get()
+    {
+        return *std::get_if<State>(&current);
+    }
+
+    template<typename Visitor>
+    decltype(auto) visit(Visitor&& visitor)
+    {
+        return std::visit(std::forward<Visitor>(visitor), current);
+    }
+
+    template<typename State, typename... Args>
+    State& transition(Args&&... args)
+    {
+        return current.template emplace<State>(std::forward<Args>(args)...);
+    }
+
+  private:
+    std::variant<States...> current;
+};
+
+} // namespace state_machine
+
+#endif // STORAGE_H
@@ -0,0 +1,143 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "types/resolve.h"
+#include "types/types.h"
+#include "types/util.h"
+#include "util/static_string.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace state_machine
+{
+
+struct Header
+{
+};
+
+struct simple_stringifier
+{
+    static constexpr auto label(types<Header>)
+    {
+        return static_string{""};
+    }
+
+    template<typename T>
+    static constexpr auto label(types<T> type)
+    {
+        return stringify(type);
+    }
+
+    template<typename T>
+    static constexpr std::size_t width(types<T> type)
+    {
+        return label(type).length();
+    }
+
+    template<std::size_t N, typename T>
+    static constexpr void write(string_builder<N>& out, types<T> type)
+    {
+        out.append(label(type));
+    }
+};
+
+template<std::size_t Width>
+struct constant_width_stringifier
+{
+    template<typename T>
+    static constexpr std::size_t width(types<T>)
+    {
+        return Width;
+    }
+
+    template<std::size_t N, typename T>
+    static constexpr void write(string_builder<N>& out, types<T> type)
+    {
+        out.append(simple_stringifier::label(type), Width, ' ');
+    }
+};
+
+namespace detail
+{
+
+// Header row cells name the events, the others the resolved actions
+template<typename Event>
+constexpr auto cell(types<Header>, types<Event> event)
+{
+    return event;
+}
+
+template<typename State, typename Event>
+constexpr auto cell(types<State>, types<Event>)
+{
+    return resolve_action{}(types<State, Event>{});
+}
+
+template<typename Stringifier, typename State, typename... Events>
+constexpr std::size_t row_length(types<State> state, types<Events...>)
+{
+    return Stringifier::width(state)
+           + (std::size_t{0} + ... + (3 + Stringifier::width(cell(state, types<Events>{})))) + 1;
+}
+
+template<typename Stringifier, std::size_t N, typename State, typename... Events>
+constexpr void write_row(string_builder<N>& out, types<State> state, types<Events...>)
+{
+    Stringifier::write(out, state);
+    ((out.append(static_string{" | "}), Stringifier::write(out, cell(state, types<Events>{}))), ...);
+    out.append(static_string{"\n"});
+}
+
+// Sizes the whole table first, then writes every row into one buffer
+template<typename Stringifier, typename... StateTypes, typename... EventTypes>
+constexpr auto render_table(types<StateTypes...>, types<EventTypes...> events)
+{
+    constexpr std::size_t length = row_length<Stringifier>(types<Header>{}, events)
+                                   + (std::size_t{0} + ... + row_length<Stringifier>(types<StateTypes>{}, events));
+
+    string_builder<length + 1> out;
+    write_row<Stringifier>(out, types<Header>{}, events);
+    (write_row<Stringifier>(out, types<StateTypes>{}, events), ...);
+    return out.str();
+}
+
+template<typename... Ts>
+constexpr std::size_t max_length(types<Ts...>)
+{
+    return std::max({std::size_t{0}, stringify(types<Ts>{}).length()...});
+}
+
+} // namespace detail
+
+template<typename... StateTypes, typename... EventTypes>
+constexpr auto generate_transition_table(types<StateTypes...> states,
+                                         types<EventTypes...> events)
+{
+    constexpr auto result = detail::render_table<simple_stringifier>(states, events);
+
+    return result;
+}
+
+// Width of the widest state, event or action label of the table
+template<typename... StateTypes, typename... EventTypes>
+constexpr std::size_t label_width(types<StateTypes...> states, types<EventTypes...> events)
+{
+    constexpr auto actions = (states * events) | map_and_join(resolve_action{});
+
+    return detail::max_length(states + events + actions);
+}
+
+template<typename... StateTypes, typename... EventTypes>
+constexpr auto generate_pretty_transition_table(types<StateTypes...> states,
+                                                types<EventTypes...> events)
+{
+    using stringifier = constant_width_stringifier<label_width(states, events)>;
+    constexpr auto result = detail::render_table<stringifier>(states, events);
+
+    return result;
+}
+
+} // namespace state_machine
+
+#endif // TABLE_H
@@ -0,0 +1,357 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace state_machine
+{
+
+// Clock that only moves when told to, for deterministic timer tests
+class virtual_clock
+{
+  public:
+    using duration   = std::chrono::nanoseconds;
+    using rep        = duration::rep;
+    using period     = duration::period;
+    using time_point = std::chrono::time_point<virtual_clock>;
+
+    static constexpr bool is_steady = true;
+
+    time_point now() const
+    {
+        return current;
+    }
+
+    void advance(duration by)
+    {
+        current += by;
+    }
+
+  private:
+    time_point current{};
+};
+
+struct timer_id
+{
+    std::uint32_t index      = UINT32_MAX;
+    std::uint32_t generation = 0;
+};
+
+// Hierarchical timer wheel delivering delayed events to many machines.
+// Four levels of 256 slots cover 2^32 ticks; later deadlines wait in the
+// last level and are re-filed as it turns. Timers live in one slab and the
+// slots are intrusive lists, so schedule() and cancel() are O(1) and do not
+// allocate once the slab has grown to the number of pending timers.
+//
+// poll() advances the wheel to the clock's current tick and hands the
+// expired timers, in deadline order, to deliver(first, last) as
+// (target id, event) pairs, the batch_entry layout of machine_pool. It
+// only stops at ticks that expire or re-file timers, so a clock jump costs
+// at most one scan of each level per such tick, not one step per tick.
+template<typename Clock, typename... Events>
+class timer_wheel
+{
+  public:
+    using event = std::variant<Events...>;
+    using entry = std::pair<std::size_t, event>;
+
+    timer_wheel(const Clock& clock, typename Clock::duration tick)
+      : clock(clock)
+      , tick(tick)
+      , origin(clock.now())
+    {
+        for (auto& level : slots)
+        {
+            level.fill(npos);
+        }
+    }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    // Delivers event to target once delay has passed, rounded up to whole
+    // ticks and to at least the next tick
+    template<typename Event, typename Rep, typename Period>
+    timer_id schedule(std::size_t target, std::chrono::duration<Rep, Period> delay, Event&& e)
+    {
+        const auto          ticks = (delay + tick - typename Clock::duration{1}) / tick;
+        const std::uint64_t deadline =
+          std::max(now() + std::max<std::int64_t>(ticks, 0), current + 1);
+
+        std::uint32_t index;
+        if (free != npos)
+        {
+            index = free;
+            free  = nodes[index].next;
+        }
+        else
+        {
+            index = static_cast<std::uint32_t>(nodes.size());
+            nodes.emplace_back();
+        }
+
+        node& n    = nodes[index];
+        n.deadline = deadline;
+        n.target   = target;
+        n.payload  = std::forward<Event>(e);
+        n.active   = true;
+        file(index);
+        ++pending;
+        return {index, n.generation};
+    }
+
+    // Returns false when the timer already fired or was cancelled
+    bool cancel(timer_id id)
+    {
+        if (id.index >= nodes.size() || nodes[id.index].generation != id.generation
+            || !nodes[id.index].active)
+        {
+            return false;
+        }
+        unlink(id.index);
+        release(id.index);
+        --pending;
+        return true;
+    }
+
+    std::size_t size() const
+    {
+        return pending;
+    }
+
+    // Fires every timer due by now; returns how many fired
+    template<typename Deliver>
+    std::size_t poll(Deliver&& deliver)
+    {
+        const std::uint64_t target = now();
+        expired.clear();
+
+        while (current < target)
+        {
+            const std::uint64_t at = pending == 0 ? target + 1 : next_turn(target + 1);
+            if (at > target)
+            {
+                current = target;
+                break;
+            }
+            turn(current = at);
+        }
+
+        if (!expired.empty())
+        {
+            deliver(expired.data(), expired.data() + expired.size());
+        }
+        return expired.size();
+    }
+
+  private:
+    static constexpr std::uint32_t npos       = UINT32_MAX;
+    static constexpr unsigned      levels     = 4;
+    static constexpr unsigned      level_bits = 8;
+    static constexpr std::uint64_t level_mask = (1u << level_bits) - 1;
+
+    struct node
+    {
+        std::uint64_t deadline = 0;
+        std::size_t   target   = 0;
+        event         payload;
+        std::uint32_t prev       = npos;
+        std::uint32_t next       = npos;
+        std::uint32_t generation = 0;
+        std::uint8_t  level      = 0;
+        std::uint8_t  slot       = 0;
+        bool          active     = false;
+    };
+
+    std::uint64_t now() const
+    {
+        return (clock.now() - origin) / tick;
+    }
+
+    // Files a timer into the slot of the lowest level whose span still
+    // reaches its deadline
+    void file(std::uint32_t index)
+    {
+        node&               n     = nodes[index];
+        const std::uint64_t delta = n.deadline - current;
+
+        unsigned level = 0;
+        while (level + 1 < levels && delta >> (level_bits * (level + 1)) != 0)
+        {
+            ++level;
+        }
+
+        const std::uint64_t last     = current + (std::uint64_t{1} << (level_bits * levels)) - 1;
+        const std::uint64_t deadline = std::min(n.deadline, last);
+        n.level                      = static_cast<std::uint8_t>(level);
+        n.slot = static_cast<std::uint8_t>((deadline >> (level_bits * level)) & level_mask);
+
+        std::uint32_t& head = slots[level][n.slot];
+        n.prev              = npos;
+        n.next              = head;
+        if (head != npos)
+        {
+            nodes[head].prev = index;
+        }
+        head = index;
+    }
+
+    void unlink(std::uint32_t index)
+    {
+        node& n = nodes[index];
+        if (n.prev != npos)
+        {
+            nodes[n.prev].next = n.next;
+        }
+        else
+        {
+            slots[n.level][n.slot] = n.next;
+        }
+        if (n.next != npos)
+        {
+            nodes[n.next].prev = n.prev;
+        }
+    }
+
+    void release(std::uint32_t index)
+    {
+        node& n  = nodes[index];
+        n.active = false;
+        ++n.generation;
+        n.next = free;
+        free   = index;
+    }
+
+    // Takes the whole list out of a slot
+    std::uint32_t take(unsigned level, std::size_t slot)
+    {
+        const std::uint32_t head = slots[level][slot];
+        slots[level][slot]       = npos;
+        return head;
+    }
+
+    // First tick after current, or limit if it comes first, at which turn()
+    // finds a timer: a non-empty level 0 slot, or a non-empty higher-level
+    // slot the wheel enters. A level's slots come round every 256 of its
+    // ticks, so one round of each is all there is to scan.
+    std::uint64_t next_turn(std::uint64_t limit) const
+    {
+        std::uint64_t next = limit;
+        for (unsigned level = 0; level < levels; ++level)
+        {
+            const unsigned      shift = level_bits * level;
+            const std::uint64_t step  = std::uint64_t{1} << shift;
+            std::uint64_t       at    = ((current >> shift) + 1) << shift;
+            for (std::size_t slot = 0; slot <= level_mask && at < next; ++slot, at += step)
+            {
+                if (slots[level][(at >> shift) & level_mask] != npos)
+                {
+                    next = at;
+                }
+            }
+        }
+        return next;
+    }
+
+    void turn(std::uint64_t at)
+    {
+        // Re-file the timers of every higher-level slot this tick enters
+        for (unsigned level = 1; level < levels; ++level)
+        {
+            if ((at & ((std::uint64_t{1} << (level_bits * level)) - 1)) != 0)
+            {
+                break;
+            }
+            const std::size_t slot = (at >> (level_bits * level)) & level_mask;
+            for (std::uint32_t index = take(level, slot); index != npos;)
+            {
+                const std::uint32_t next = nodes[index].next;
+                file(index);
+                index = next;
+            }
+        }
+
+        // Timers filed into one slot are listed newest first
+        const std::size_t first = expired.size();
+        for (std::uint32_t index = take(0, at & level_mask); index != npos;)
+        {
+            node&               n    = nodes[index];
+            const std::uint32_t next = n.next;
+            expired.emplace_back(n.target, std::move(n.payload));
+            release(index);
+            --pending;
+            index = next;
+        }
+        std::reverse(expired.begin() + first, expired.end());
+    }
+
+    const Clock&                                       clock;
+    const typename Clock::duration                     tick;
+    const typename Clock::time_point                   origin;
+    std::uint64_t                                      current = 0;
+    std::size_t                                        pending = 0;
+    std::vector<node>                                  nodes;
+    std::uint32_t                                      free = npos;
+    std::array<std::array<std::uint32_t, 256>, levels> slots;
+    std::vector<entry>                                 expired;
+};
+
+// Driver that lets the actions of one machine schedule and cancel delayed
+// events through a shared wheel, addressed to the machine's id. It is
+// passed to actions in place of the machine, like event_queue.
+template<typename Machine, typename Wheel>
+class timed
+{
+  public:
+    timed(Machine& machine, Wheel& wheel, std::size_t id)
+      : machine(machine)
+      , wheel(wheel)
+      , id(id)
+    {
+    }
+
+    template<typename State, typename... Args>
+    State& transition(Args&&... args)
+    {
+        return machine.template transition<State>(std::forward<Args>(args)...);
+    }
+
+    template<typename Event, typename Rep, typename Period>
+    timer_id schedule(std::chrono::duration<Rep, Period> delay, Event&& event)
+    {
+        return wheel.schedule(id, delay, std::forward<Event>(event));
+    }
+
+    bool cancel(timer_id timer)
+    {
+        return wheel.cancel(timer);
+    }
+
+    template<typename Event>
+    void handle(const Event& event)
+    {
+        machine.handle_by(event, *this);
+    }
+
+    template<typename... Events>
+    void handle(const std::variant<Events...>& event)
+    {
+        std::visit([this](const auto& e) { handle(e); }, event);
+    }
+
+  private:
+    Machine&          machine;
+    Wheel&            wheel;
+    const std::size_t id;
+};
+
+} // namespace state_machine
+
+#endif // TIMER_WHEEL_H
@@ -2,6 +2,13 @@
 #define TYPES_H
 
 #include <cstddef>
+#include <utility>
+
+#if defined(__has_builtin)
+#if __has_builtin(__type_pack_element)
+#define STATE_MACHINE_HAS_TYPE_PACK_ELEMENT
+#endif
+#endif
 
 namespace state_machine
 {
@@ -11,22 +18,106 @@ struct types
 {
 };
 
-template<typename... Lhs, typename... Rhs>
-constexpr auto operator+(types<Lhs...>, types<Rhs...>)
+namespace detail
 {
-    return types<Lhs..., Rhs...>{};
-}
+
+// Concatenates up to eight lists per instantiation, so joining N lists
+// costs N / 8 instantiations instead of one per pairwise operator+
+template<typename... Lists>
+struct concat;
+
+template<>
+struct concat<>
+{
+    using type = types<>;
+};
+
+template<typename... A>
+struct concat<types<A...>>
+{
+    using type = types<A...>;
+};
+
+template<typename... A, typename... B, typename... Rest>
+struct concat<types<A...>, types<B...>, Rest...> : concat<types<A..., B...>, Rest...>
+{
+};
+
+template<typename... A,
+         typename... B,
+         typename... C,
+         typename... D,
+         typename... E,
+         typename... F,
+         typename... G,
+         typename... H,
+         typename... Rest>
+struct concat<types<A...>,
+              types<B...>,
+              types<C...>,
+              types<D...>,
+              types<E...>,
+              types<F...>,
+              types<G...>,
+              types<H...>,
+              Rest...> : concat<types<A..., B..., C..., D..., E..., F..., G..., H...>, Rest...>
+{
+};
 
 template<typename Lhs, typename... Rhs>
-constexpr auto operator*(types<Lhs>, types<Rhs...>)
+using product_row = types<types<Lhs, Rhs>...>;
+
+template<std::size_t I, typename T>
+struct indexed
 {
-    return types<types<Lhs, Rhs>...>{};
+    using type = T;
+};
+
+template<typename Indices, typename... Ts>
+struct indexer;
+
+template<std::size_t... I, typename... Ts>
+struct indexer<std::index_sequence<I...>, Ts...> : indexed<I, Ts>...
+{
+};
+
+template<std::size_t I, typename T>
+indexed<I, T> select(const indexed<I, T>&);
+
+} // namespace detail
+
+template<typename... Lists>
+using concat_t = typename detail::concat<Lists...>::type;
+
+// I-th type of the list, looked up without recursing over the list
+template<std::size_t I, typename List>
+struct at;
+
+template<std::size_t I, typename... Ts>
+struct at<I, types<Ts...>>
+{
+#ifdef STATE_MACHINE_HAS_TYPE_PACK_ELEMENT
+    using type = __type_pack_element<I, Ts...>;
+#else
+    using type = typename decltype(detail::select<I>(
+      detail::indexer<std::index_sequence_for<Ts...>, Ts...>{}))::type;
+#endif
+};
+
+template<std::size_t I, typename List>
+using at_t = typename at<I, List>::type;
+
+template<typename... Lhs, typename... Rhs>
+constexpr auto operator+(types<Lhs...>, types<Rhs...>)
+{
+    return types<Lhs..., Rhs...>{};
 }
 
-template<typename... Lhs, typename Rhs>
-constexpr auto operator*(types<Lhs...>, Rhs rhs)
+// Cartesian product as one list of types<Lhs, Rhs> pairs, row by row
+template<typename... Lhs, typename... Rhs>
+constexpr auto operator*(types<Lhs...>, types<Rhs...>)
 {
-    return ((types<Lhs>{} * rhs) + ...);
+    return concat_t<detail::product_row<Lhs, Rhs...>...>{};
 }
 
 template<typename... Ts, typename Operation>
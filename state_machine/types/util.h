@@ -3,9 +3,93 @@
 
 #include "types.h"
 
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
 namespace state_machine
 {
 
+template<typename T>
+struct is_types : std::false_type
+{
+};
+
+template<typename... Ts>
+struct is_types<types<Ts...>> : std::true_type
+{
+};
+
+template<typename... Ts>
+constexpr auto join_all(Ts... values);
+
+namespace detail
+{
+
+template<std::size_t I, typename T>
+struct slot
+{
+    T value;
+};
+
+// Flat indexed storage for the operands of one join_all level; unlike
+// std::tuple it does not instantiate one base per remaining element
+template<typename Indices, typename... Ts>
+struct slots;
+
+template<std::size_t... I, typename... Ts>
+struct slots<std::index_sequence<I...>, Ts...> : slot<I, Ts>...
+{
+    constexpr slots(Ts... values)
+      : slot<I, Ts>{values}...
+    {
+    }
+};
+
+template<std::size_t I, typename T>
+constexpr const T& get(const slot<I, T>& s)
+{
+    return s.value;
+}
+
+template<typename Slots, std::size_t Count, std::size_t... I>
+constexpr auto join_pairs(const Slots& values, std::index_sequence<I...>)
+{
+    if constexpr (Count % 2 == 0)
+    {
+        return join_all((get<2 * I>(values) + get<2 * I + 1>(values))...);
+    }
+    else
+    {
+        return join_all((get<2 * I>(values) + get<2 * I + 1>(values))...,
+                        get<Count - 1>(values));
+    }
+}
+
+} // namespace detail
+
+// Sum of all values: type lists are concatenated in batches, anything else
+// is added pairwise in a balanced tree, so each value is copied log N times
+// rather than once per remaining operand
+template<typename... Ts>
+constexpr auto join_all(Ts... values)
+{
+    if constexpr ((is_types<Ts>::value && ...))
+    {
+        return concat_t<Ts...>{};
+    }
+    else if constexpr (sizeof...(Ts) == 1)
+    {
+        return (values, ...);
+    }
+    else
+    {
+        using storage = detail::slots<std::index_sequence_for<Ts...>, Ts...>;
+        return detail::join_pairs<storage, sizeof...(Ts)>(
+          storage{values...}, std::make_index_sequence<sizeof...(Ts) / 2>());
+    }
+}
+
 template<typename Operation>
 class map_and_join
 {
@@ -18,13 +102,34 @@ class map_and_join
     template<typename... Ts>
     constexpr auto operator()(types<Ts>... rhs)
     {
-        return (operation(rhs) + ...);
+        return join_all(operation(rhs)...);
     }
 
   private:
     Operation operation;
 };
 
+template<typename T>
+struct type_of;
+
+template<typename T>
+struct type_of<types<T>>
+{
+    using type = T;
+};
+
+template<typename T>
+using type_of_t = typename type_of<T>::type;
+
+// Position of T in the list, or the list size when T is absent
+template<typename T, typename... Ts>
+constexpr std::size_t index_of(types<Ts...>)
+{
+    std::size_t index = 0;
+    (void)((std::is_same_v<T, Ts> || (++index, false)) || ...);
+    return index;
+}
+
 } // namespace state_machine
 
 #endif // UTIL_H
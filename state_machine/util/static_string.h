@@ -56,4 +56,39 @@ class static_string
     std::array<const char, N> chars;
 };
 
+// Fixed buffer of N characters, terminator included, written front to
+// back in a constant expression. The caller computes N up front, so a
+// whole text costs one buffer instead of one static_string per operator+
+template<std::size_t N>
+class string_builder
+{
+  public:
+    template<std::size_t M>
+    constexpr string_builder& append(const static_string<M>& text)
+    {
+        return append(text, text.length(), ' ');
+    }
+
+    // Appends text cut or padded with fill to width characters, like
+    // static_string::change_length
+    template<std::size_t M>
+    constexpr string_builder& append(const static_string<M>& text, std::size_t width, char fill)
+    {
+        for (std::size_t i = 0; i < width; ++i)
+        {
+            chars[length++] = i < text.length() ? text.data()[i] : fill;
+        }
+        return *this;
+    }
+
+    constexpr static_string<N> str() const
+    {
+        return static_string<N>{to_stdarray(chars)};
+    }
+
+  private:
+    char        chars[N]{};
+    std::size_t length = 0;
+};
+
 #endif // STATIC_STRING_H
@@ -1,19 +1,53 @@
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <numeric>
 #include <sstream>
 #include <iostream>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
 using strings = vector<string>;
-using ints = vector<int>;
 
-std::string extract_extension(const std::string& filename)
+string_view extract_extension(string_view filename)
 {
     auto pos = filename.find_last_of('.');
 
-    if (pos == std::string::npos)
-        return string{};
+    if (pos == string_view::npos)
+        return string_view{};
     else
         return filename.substr(pos + 1);
 }
@@ -25,27 +59,207 @@ enum class category : unsigned {
     cat_other
 };
 
-const strings extensions = {
-    "mp4/mkv/avi",
-    "jpg/bmp/gif",
-    "mp3/flac/wav"
-};
+// Extension lower-cased and packed into a word, one byte per character;
+// 0 when it is empty or longer than a word
+constexpr uint64_t pack_extension(string_view ext)
+{
+    if (ext.empty() || ext.size() > sizeof(uint64_t))
+        return 0;
+
+    uint64_t key = 0;
+
+    for (size_t i = 0; i < ext.size(); i++) {
+        uint64_t c = static_cast<unsigned char>(ext[i]);
+
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        key |= c << (8 * i);
+    }
 
-category get_category(const string& file_name)
+    return key;
+}
+
+constexpr uint64_t mix(uint64_t key, uint64_t seed)
 {
-    category result = category::cat_other;
-    size_t idx = 0;
+    key ^= seed * 0x9e3779b97f4a7c15ull;
+    key ^= key >> 31;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 29;
+    key *= 0x94d049bb133111ebull;
+    return key ^ (key >> 32);
+}
 
-    if (const auto& ext = extract_extension(file_name);
-            !ext.empty())
-        for (auto& cat : extensions) {
-            if (cat.find(ext) != string::npos)
-                result = static_cast<category>(idx);
-            else
-                idx++;
+struct extension {
+    string_view name;
+    category cat;
+};
+
+// Perfect hash from packed extensions to categories, built by hash and
+// displace: keys are spread over Slots / 4 buckets, and every bucket gets
+// the first seed that sends all its keys to free slots. A lookup is then
+// two hashes and one compare, whatever the number of extensions.
+template<size_t Slots>
+class extension_table {
+public:
+    static_assert((Slots & (Slots - 1)) == 0 && Slots >= 8);
+
+    static constexpr size_t capacity = Slots / 2;
+
+    // false when an extension is too long or there are more than capacity
+    // of them; a repeated extension takes the category listed last
+    constexpr bool build(const extension* first, size_t count)
+    {
+        *this = extension_table{};
+
+        if (count > capacity)
+            return false;
+
+        array<uint64_t, capacity> pending{};
+        array<category, capacity> pending_cats{};
+        size_t unique = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            auto key = pack_extension(first[i].name);
+            size_t j = 0;
+
+            if (key == 0)
+                return false;
+
+            while (j < unique && pending[j] != key)
+                j++;
+
+            pending[j] = key;
+            pending_cats[j] = first[i].cat;
+            unique += j == unique;
         }
 
-    return result;
+        // Largest buckets first, while most slots are still free
+        array<size_t, buckets> sizes{};
+
+        for (size_t i = 0; i < unique; i++)
+            sizes[bucket(pending[i])]++;
+
+        for (size_t size = capacity; size > 0; size--)
+            for (size_t b = 0; b < buckets; b++)
+                if (sizes[b] == size && !place(b, pending, pending_cats, unique))
+                    return false;
+
+        return true;
+    }
+
+    constexpr category find(string_view ext) const
+    {
+        auto key = pack_extension(ext);
+        auto slot = mix(key, seeds[bucket(key)]) & (Slots - 1);
+
+        return key != 0 && keys[slot] == key ? cats[slot] : category::cat_other;
+    }
+
+private:
+    static constexpr size_t buckets = Slots / 4;
+
+    static constexpr size_t bucket(uint64_t key)
+    {
+        return mix(key, 0) & (buckets - 1);
+    }
+
+    template<typename Keys, typename Cats>
+    constexpr bool place(size_t b, const Keys& pending, const Cats& pending_cats, size_t count)
+    {
+        for (uint32_t seed = 1; seed <= UINT16_MAX; seed++) {
+            array<size_t, capacity> taken{};
+            size_t placed = 0;
+            bool fits = true;
+
+            for (size_t i = 0; i < count && fits; i++) {
+                if (bucket(pending[i]) != b)
+                    continue;
+
+                auto slot = mix(pending[i], seed) & (Slots - 1);
+
+                fits = keys[slot] == 0;
+
+                for (size_t j = 0; j < placed && fits; j++)
+                    fits = taken[j] != slot;
+
+                taken[placed++] = slot;
+            }
+
+            if (!fits)
+                continue;
+
+            for (size_t i = 0, j = 0; i < count; i++)
+                if (bucket(pending[i]) == b) {
+                    keys[taken[j]] = pending[i];
+                    cats[taken[j++]] = pending_cats[i];
+                }
+
+            seeds[b] = static_cast<uint16_t>(seed);
+            return true;
+        }
+
+        return false;
+    }
+
+    array<uint64_t, Slots> keys{};
+    array<category, Slots> cats{};
+    array<uint16_t, buckets> seeds{};
+};
+
+constexpr extension builtin_extensions[] = {
+    {"mp4", category::cat_movies}, {"mkv", category::cat_movies}, {"avi", category::cat_movies},
+    {"mov", category::cat_movies}, {"wmv", category::cat_movies}, {"flv", category::cat_movies},
+    {"webm", category::cat_movies}, {"m4v", category::cat_movies}, {"mpg", category::cat_movies},
+    {"mpeg", category::cat_movies}, {"m2ts", category::cat_movies}, {"mts", category::cat_movies},
+    {"vob", category::cat_movies}, {"ogv", category::cat_movies}, {"3gp", category::cat_movies},
+    {"3g2", category::cat_movies}, {"asf", category::cat_movies}, {"rm", category::cat_movies},
+    {"rmvb", category::cat_movies}, {"divx", category::cat_movies}, {"f4v", category::cat_movies},
+    {"mxf", category::cat_movies},
+
+    {"jpg", category::cat_images}, {"jpeg", category::cat_images}, {"bmp", category::cat_images},
+    {"gif", category::cat_images}, {"png", category::cat_images}, {"tif", category::cat_images},
+    {"tiff", category::cat_images}, {"webp", category::cat_images}, {"heic", category::cat_images},
+    {"heif", category::cat_images}, {"avif", category::cat_images}, {"raw", category::cat_images},
+    {"cr2", category::cat_images}, {"nef", category::cat_images}, {"arw", category::cat_images},
+    {"dng", category::cat_images}, {"orf", category::cat_images}, {"svg", category::cat_images},
+    {"ico", category::cat_images}, {"psd", category::cat_images}, {"xcf", category::cat_images},
+    {"jp2", category::cat_images}, {"exr", category::cat_images}, {"tga", category::cat_images},
+    {"pcx", category::cat_images},
+
+    {"mp3", category::cat_music}, {"flac", category::cat_music}, {"wav", category::cat_music},
+    {"aac", category::cat_music}, {"ogg", category::cat_music}, {"oga", category::cat_music},
+    {"opus", category::cat_music}, {"m4a", category::cat_music}, {"wma", category::cat_music},
+    {"aiff", category::cat_music}, {"aif", category::cat_music}, {"alac", category::cat_music},
+    {"ape", category::cat_music}, {"mid", category::cat_music}, {"midi", category::cat_music},
+    {"mka", category::cat_music}, {"wv", category::cat_music}, {"dsf", category::cat_music},
+    {"dff", category::cat_music}, {"amr", category::cat_music}, {"au", category::cat_music},
+};
+
+using category_registry = extension_table<1024>;
+
+constexpr category_registry make_builtin_registry()
+{
+    category_registry table;
+
+    if (!table.build(builtin_extensions, size(builtin_extensions)))
+        throw logic_error("built-in extensions do not fit the registry");
+
+    return table;
+}
+
+constexpr category_registry builtin_registry = make_builtin_registry();
+
+static_assert(builtin_registry.find("MKV") == category::cat_movies);
+static_assert(builtin_registry.find("mp") == category::cat_other);
+static_assert(builtin_registry.find("m") == category::cat_other);
+
+// Starts as the built-in table; load_categories() rebuilds it
+category_registry registry = builtin_registry;
+
+category get_category(string_view file_name)
+{
+    return registry.find(extract_extension(file_name));
 }
 
 ostream& operator<<(ostream& s, category cat)
@@ -71,73 +285,947 @@ ostream& operator<<(ostream& s, category cat)
     return s;
 }
 
-strings split(const string& s, char delimiter)
+int catoi(category cat)
+{
+    return static_cast<int>(cat);
+}
+
+category itocat(size_t i)
 {
-    istringstream input_stream(s);
-    string token;
-    strings result;
+    return static_cast<category>(i);
+}
+
+// Adds "<category> <extension>..." lines to the built-in extensions;
+// an extension already known moves to the category given last
+bool load_categories(const char* path)
+{
+    ifstream file(path);
+    stringstream content;
 
-    while (getline(input_stream, token, input_stream.widen(delimiter)))
-        result.push_back(move(token));
+    // Inserting a buffer with nothing in it fails, so an empty file is
+    // only peeked at; reading a directory leaves the stream bad
+    auto empty = file && file.peek() == ifstream::traits_type::eof();
 
-    return result;
+    if (!file || file.bad() || (!empty && !(content << file.rdbuf()))) {
+        cerr << path << ": cannot read" << endl;
+        return false;
+    }
+
+    const string text = content.str();
+    vector<extension> entries(begin(builtin_extensions), end(builtin_extensions));
+    const string_view names[] = {"movies", "images", "music", "other"};
+    size_t line = 0;
+
+    for (size_t start = 0; start < text.size(); ) {
+        auto stop = min(text.find('\n', start), text.size());
+        auto fields = string_view(text).substr(start, stop - start);
+        start = stop + 1;
+        line++;
+
+        fields = fields.substr(0, fields.find('#'));
+
+        string_view name;
+        size_t cat = size(names);
+
+        for (size_t pos = 0; pos < fields.size(); ) {
+            auto first = fields.find_first_not_of(" \t\r", pos);
+
+            if (first == string_view::npos)
+                break;
+
+            auto last = min(fields.find_first_of(" \t\r", first), fields.size());
+            auto word = fields.substr(first, last - first);
+            pos = last;
+
+            if (name.empty()) {
+                name = word;
+                cat = find(begin(names), end(names), name) - begin(names);
+            } else if (cat < size(names))
+                entries.push_back({word, itocat(cat)});
+        }
+
+        if (!name.empty() && cat == size(names)) {
+            cerr << path << ":" << line << ": unknown category " << name << endl;
+            return false;
+        }
+    }
+
+    if (!registry.build(entries.data(), entries.size())) {
+        cerr << path << ": extensions are longer than " << sizeof(uint64_t)
+             << " characters or more than " << category_registry::capacity << endl;
+        return false;
+    }
+
+    return true;
 }
 
-string chomp(const string& s)
+// Per-category totals of a listing
+struct totals {
+    uint64_t bytes[4] = {};
+    uint64_t files[4] = {};
+    uint64_t malformed = 0;
+    uint64_t unreadable = 0;
+
+    totals& operator+=(const totals& other)
+    {
+        for (size_t i = 0; i < 4; i++) {
+            bytes[i] += other.bytes[i];
+            files[i] += other.files[i];
+        }
+
+        malformed += other.malformed;
+        unreadable += other.unreadable;
+        return *this;
+    }
+};
+
+// A worker's totals, on cache lines of their own
+struct alignas(64) padded_totals : totals {
+};
+
+// Accounts the record in line[0, length), given the offsets of its last
+// space and last dot, npos when there is none: "<name> <size>b", the name
+// being everything before the last space
+void account(const char* line, size_t length, size_t space, size_t dot, totals& t)
 {
-    return string(s.begin(), s.end() - 1);
+    if (length != 0 && line[length - 1] == '\r')
+        length--;
+
+    if (length == 0)
+        return;
+
+    if (space == string_view::npos || space == 0 || space >= length) {
+        t.malformed++;
+        return;
+    }
+
+    uint64_t size;
+    auto first = line + space + 1;
+    auto last = line + length;
+    auto [end, ec] = from_chars(first, last, size);
+
+    if (ec != errc{} || end == first || !(end == last || (end + 1 == last && *end == 'b'))) {
+        t.malformed++;
+        return;
+    }
+
+    auto ext = dot < space ? string_view(line + dot + 1, space - dot - 1) : string_view{};
+    auto cat = catoi(registry.find(ext));
+
+    t.bytes[cat] += size;
+    t.files[cat]++;
 }
 
-int catoi(category cat)
+void account(string_view line, totals& t)
 {
-    return static_cast<int>(cat);
+    auto space = line.find_last_of(' ');
+    auto dot = line.find_last_of('.', space);
+
+    account(line.data(), line.size(), space, dot, t);
 }
 
-category itocat(size_t i)
+// Newlines, spaces and dots of a 64-byte block, one bit per byte
+struct block_masks {
+    uint64_t newline;
+    uint64_t space;
+    uint64_t dot;
+};
+
+block_masks classify(const char* p, size_t n)
 {
-    return static_cast<category>(i);
+    block_masks m = {0, 0, 0};
+
+    for (size_t i = 0; i < n; i++) {
+        m.newline |= uint64_t(p[i] == '\n') << i;
+        m.space |= uint64_t(p[i] == ' ') << i;
+        m.dot |= uint64_t(p[i] == '.') << i;
+    }
+
+    return m;
 }
 
-int main()
+block_masks classify(const char* p)
 {
-    string input = {
-        "hjhasd.ghsda 12249b\n"
-        "explorer.exe 8299b\n"
-        "newsong.mp3 10000b\n"
-        "thisisnewshit!.flac 200000b\n"
-        "movie.mkv 10000b\n"
-        "dick.jpg 289b\n"
-        "autorun 10b"
+#if defined(__AVX2__)
+    auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    auto match = [lo, hi](char c) {
+        auto v = _mm256_set1_epi8(c);
+        uint64_t l = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)));
+        uint64_t h = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v)));
+
+        return l | h << 32;
+    };
+
+    return {match('\n'), match(' '), match('.')};
+#elif defined(__SSE2__)
+    __m128i q[4];
+
+    for (size_t i = 0; i < 4; i++)
+        q[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+
+    auto match = [&q](char c) {
+        auto v = _mm_set1_epi8(c);
+        uint64_t m = 0;
+
+        for (size_t i = 0; i < 4; i++)
+            m |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(q[i], v)))) << (16 * i);
+
+        return m;
+    };
+
+    return {match('\n'), match(' '), match('.')};
+#else
+    return classify(p, 64);
+#endif
+}
+
+// Accounts every complete line of text and returns how much of it they
+// took; the unterminated tail is left for the caller. The text is read
+// once, a block at a time, into masks of its newlines, spaces and dots;
+// records, with their last space and dot, come out of the masks alone.
+size_t scan(string_view text, totals& t)
+{
+    const auto npos = string_view::npos;
+    size_t start = 0;
+    size_t space = npos;
+    size_t dot = npos;
+
+    for (size_t block = 0; block < text.size(); block += 64) {
+        auto n = min<size_t>(64, text.size() - block);
+        auto m = n == 64 ? classify(text.data() + block) : classify(text.data() + block, n);
+
+        while (m.newline) {
+            size_t bit = __builtin_ctzll(m.newline);
+            uint64_t below = (uint64_t(1) << bit) - 1;
+
+            if (auto s = m.space & below)
+                space = block + 63 - __builtin_clzll(s);
+
+            if (auto d = m.dot & below)
+                dot = block + 63 - __builtin_clzll(d);
+
+            auto end = block + bit;
+
+            account(text.data() + start, end - start,
+                    space == npos ? npos : space - start,
+                    dot == npos ? npos : dot - start, t);
+
+            start = end + 1;
+            space = dot = npos;
+            m.space &= ~below << 1;
+            m.dot &= ~below << 1;
+            m.newline &= m.newline - 1;
+        }
+
+        if (m.space)
+            space = block + 63 - __builtin_clzll(m.space);
+
+        if (m.dot)
+            dot = block + 63 - __builtin_clzll(m.dot);
+    }
+
+    return start;
+}
+
+// Walks [first, last), which starts at a line, a window at a time, handing
+// the pages behind it back to the kernel, so the resident set stays at about
+// one window
+void scan_mapped(const char* first, const char* last, totals& t)
+{
+    const size_t window = 16 << 20;
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+
+    auto done = first;
+    auto released = reinterpret_cast<uintptr_t>(first) / page * page;
+
+    while (done < last) {
+        auto chunk = string_view(done, min<size_t>(window, last - done));
+
+        if (chunk.end() == last) {
+            done += scan(chunk, t);
+            account(string_view(done, last - done), t);
+            done = last;
+        } else {
+            auto used = scan(chunk, t);
+
+            // A line longer than the window: take the rest of it whole
+            if (used == 0) {
+                auto end = static_cast<const char*>(memchr(chunk.end(), '\n', last - chunk.end()));
+                auto size = (end ? end : last) - done;
+
+                account(string_view(done, size), t);
+                used = end ? size + 1 : size;
+            }
+
+            done += used;
+        }
+
+        auto drop = reinterpret_cast<uintptr_t>(done) / page * page;
+
+        if (drop > released) {
+            madvise(reinterpret_cast<void*>(released), drop - released, MADV_DONTNEED);
+            released = drop;
+        }
+    }
+}
+
+// Splits the mapped file at line boundaries into one range per thread;
+// each worker sums its own range into its own counters, which are added up
+// once all are done
+bool stream_mapped(int fd, size_t length, unsigned threads, totals& t)
+{
+    auto base = static_cast<const char*>(mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0));
+
+    if (base == MAP_FAILED)
+        return false;
+
+    madvise(const_cast<char*>(base), length, MADV_SEQUENTIAL);
+
+    vector<padded_totals> partial(threads);
+    vector<thread> workers;
+    auto first = base;
+
+    for (unsigned i = 0; i < threads; i++) {
+        auto last = max(first, base + length / threads * (i + 1));
+
+        if (i + 1 == threads)
+            last = base + length;
+        else if (last > first) {
+            auto end = static_cast<const char*>(memchr(last - 1, '\n', base + length - (last - 1)));
+            last = end ? end + 1 : base + length;
+        }
+
+        if (i + 1 == threads)
+            scan_mapped(first, last, partial[i]);
+        else
+            workers.emplace_back(scan_mapped, first, last, ref<totals>(partial[i]));
+
+        first = last;
+    }
+
+    for (auto& w : workers)
+        w.join();
+
+    for (const auto& p : partial)
+        t += p;
+
+    munmap(const_cast<char*>(base), length);
+    return true;
+}
+
+// For pipes and anything else that cannot be mapped: one fixed buffer,
+// with the partial line at its end carried over to the next read
+bool stream_chunked(int fd, totals& t)
+{
+    vector<char> buffer(1 << 20);
+    size_t filled = 0;
+    bool skipping = false;
+
+    for (;;) {
+        auto got = read(fd, buffer.data() + filled, buffer.size() - filled);
+
+        if (got < 0)
+            return false;
+
+        if (got == 0)
+            break;
+
+        filled += got;
+
+        auto text = string_view(buffer.data(), filled);
+        size_t used = 0;
+
+        if (skipping) {
+            auto end = text.find('\n');
+
+            if (end == string_view::npos) {
+                filled = 0;
+                continue;
+            }
+
+            used = end + 1;
+            skipping = false;
+        }
+
+        used += scan(text.substr(used), t);
+
+        // A line that does not fit the buffer is counted once and dropped
+        if (used == 0 && filled == buffer.size()) {
+            t.malformed++;
+            skipping = true;
+            used = filled;
+        }
+
+        memmove(buffer.data(), buffer.data() + used, filled - used);
+        filled -= used;
+    }
+
+    if (!skipping)
+        account(string_view(buffer.data(), filled), t);
+
+    return true;
+}
+
+void report(const totals& t)
+{
+    for (size_t i = 0; i < 4; i++)
+        cout << itocat(i) << ": " << t.bytes[i] << " (" << t.files[i] << " files)" << endl;
+
+    if (t.malformed)
+        cout << "malformed: " << t.malformed << endl;
+
+    if (t.unreadable)
+        cout << "unreadable: " << t.unreadable << endl;
+}
+
+// Streams the listing, or standard input for "-", and prints the totals.
+// Only mapped files are split between threads.
+int stream(const char* path, unsigned threads)
+{
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+
+    if (fd < 0) {
+        cerr << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    struct stat st;
+    totals t;
+    bool ok;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        ok = stream_mapped(fd, st.st_size, threads, t) || stream_chunked(fd, t);
+    else
+        ok = stream_chunked(fd, t);
+
+    if (fd != STDIN_FILENO)
+        close(fd);
+
+    if (!ok) {
+        cerr << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    report(t);
+    return 0;
+}
+
+#ifdef __linux__
+// What getdents64 returns, one record after another
+struct kernel_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[256];
+};
+#endif
+
+// Calls f(name, type) for every entry of the open directory but . and ..;
+// type is a DT_ constant, DT_UNKNOWN when the file system does not tell
+template<typename F>
+bool for_each_entry(int fd, vector<char>& buffer, F f)
+{
+    auto skip = [](const char* name) {
+        return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+    };
+
+#ifdef __linux__
+    for (;;) {
+        auto got = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+
+        if (got <= 0)
+            return got == 0;
+
+        for (long pos = 0; pos < got; ) {
+            auto entry = reinterpret_cast<const kernel_dirent64*>(buffer.data() + pos);
+
+            if (!skip(entry->d_name))
+                f(entry->d_name, entry->d_type);
+
+            pos += entry->d_reclen;
+        }
+    }
+#else
+    DIR* dir = fdopendir(dup(fd));
+
+    if (!dir)
+        return false;
+
+    while (auto entry = readdir(dir))
+        if (!skip(entry->d_name))
+            f(entry->d_name, entry->d_type);
+
+    closedir(dir);
+    return true;
+#endif
+}
+
+// Size of the entry name of the open directory, and whether it is a
+// regular file or a directory; symbolic links are not followed
+bool stat_entry(int dir, const char* name, bool& regular, bool& directory, uint64_t& size)
+{
+#if defined(__linux__) && defined(STATX_SIZE)
+    struct statx st;
+
+    if (statx(dir, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_TYPE | STATX_SIZE, &st) != 0)
+        return false;
+
+    regular = S_ISREG(st.stx_mode);
+    directory = S_ISDIR(st.stx_mode);
+    size = st.stx_size;
+#else
+    struct stat st;
+
+    if (fstatat(dir, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return false;
+
+    regular = S_ISREG(st.st_mode);
+    directory = S_ISDIR(st.st_mode);
+    size = st.st_size;
+#endif
+    return true;
+}
+
+// Walks a directory tree on a pool of threads, a directory at a time.
+// Every thread has its own queue of directories left to read: it takes
+// the newest from its own, going depth first, and when that is empty
+// steals the oldest from another thread's, the top of the largest subtree
+// waiting there. Entries are read into a fixed buffer per thread and
+// sized relative to their directory, so a file costs no allocation; only
+// a directory waiting in a queue has a path of its own. The queues are
+// plain deques under a mutex each, which directory reads dwarf. A thread
+// that finds them all empty spins a little, then sleeps until a directory
+// is queued or the walk ends, so one huge directory does not keep every
+// other core busy waiting.
+class tree_walker {
+public:
+    explicit tree_walker(unsigned threads)
+        : workers(max(1u, threads))
+    {
+    }
+
+    totals walk(const char* root)
+    {
+        vector<thread> threads;
+        totals result;
+
+        workers[0].queue.push_back(root);
+        queued = 1;
+        pending = 1;
+
+        for (unsigned i = 1; i < workers.size(); i++)
+            threads.emplace_back(&tree_walker::work, this, i);
+
+        work(0);
+
+        for (auto& t : threads)
+            t.join();
+
+        for (auto& w : workers) {
+            result += w.counts;
+            w.counts = totals{};
+        }
+
+        return result;
+    }
+
+private:
+    struct alignas(64) worker {
+        mutex lock;
+        deque<string> queue;
+        totals counts;
+        vector<char> buffer;
+        string path;
     };
-    auto lines = split(input, '\n');
-    ints counters = { 0, 0, 0, 0 };
 
-    for (const auto& l : lines) {
-        const auto& str = split(l, ' ');
+    void work(unsigned self)
+    {
+        auto& me = workers[self];
+        unsigned idle = 0;
+
+        me.buffer.resize(1 << 16);
 
-        cout << str[0] << endl;
+        while (pending.load(memory_order_acquire) != 0) {
+            if (!take(self)) {
+                if (++idle > 64)
+                    sleep();
 
-        auto cat = get_category(str[0]);
-        auto size = chomp(str[1]);
+                continue;
+            }
 
-        cout << "    cat: " << cat << endl;
-        cout << "   size: " << size << endl;
-        counters[catoi(cat)] += stol(size);
+            idle = 0;
+            read_directory(me);
+
+            if (pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+                lock_guard<mutex> hold(idle_lock);
+                wake.notify_all();
+            }
+        }
+    }
 
-//        const std::regex size_regex("(^[\w,\s-]+)\. ([0-9]+)b");
-//        std::smatch base_match;
+    // Waits for a directory to be queued or for the walk to end. Sleepers
+    // are counted under idle_lock, and queue() reads the count only after
+    // publishing its directory, so either it sees the sleeper and wakes it
+    // or the sleeper sees the directory.
+    void sleep()
+    {
+        unique_lock<mutex> hold(idle_lock);
 
-//        if (std::regex_match(str[1], base_match, size_regex)) {
-//            if (base_match.size() == 2) {
-//                std::ssub_match base_sub_match = base_match[1];
-//                std::string base = base_sub_match.str();
-//                std::cout << " has size " << base << '\n';
-//            }
-//        }
+        sleepers++;
+        wake.wait(hold, [this] { return queued != 0 || pending == 0; });
+        sleepers--;
     }
 
-    for (auto& c : counters) {
-        auto icat = &c - &counters[0];
-        cout << itocat(icat) << ": " << c << endl;
+    void queue(worker& me, string path)
+    {
+        {
+            lock_guard<mutex> hold(me.lock);
+            me.queue.push_back(move(path));
+            queued++;
+        }
+
+        if (sleepers != 0) {
+            lock_guard<mutex> hold(idle_lock);
+            wake.notify_one();
+        }
     }
+
+    bool take(unsigned self)
+    {
+        auto& me = workers[self];
+
+        {
+            lock_guard<mutex> hold(me.lock);
+
+            if (!me.queue.empty()) {
+                me.path = me.queue.back();
+                me.queue.pop_back();
+                queued--;
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < workers.size(); i++) {
+            auto& victim = workers[(self + i) % workers.size()];
+            lock_guard<mutex> hold(victim.lock);
+
+            if (!victim.queue.empty()) {
+                me.path = victim.queue.front();
+                victim.queue.pop_front();
+                queued--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void read_directory(worker& me)
+    {
+        int fd = open(me.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (fd < 0) {
+            me.counts.unreadable++;
+            return;
+        }
+
+        auto entry = [this, &me, fd](const char* name, unsigned char type) {
+            bool regular = type == DT_REG;
+            bool directory = type == DT_DIR;
+            uint64_t size = 0;
+
+            if ((regular || type == DT_UNKNOWN)
+                    && !stat_entry(fd, name, regular, directory, size)) {
+                me.counts.unreadable++;
+                return;
+            }
+
+            if (directory) {
+                string child;
+
+                child.reserve(me.path.size() + 1 + strlen(name));
+                child.append(me.path).append(1, '/').append(name);
+                pending.fetch_add(1, memory_order_relaxed);
+                queue(me, move(child));
+            } else if (regular) {
+                auto cat = catoi(get_category(name));
+
+                me.counts.bytes[cat] += size;
+                me.counts.files[cat]++;
+            }
+        };
+
+        if (!for_each_entry(fd, me.buffer, entry))
+            me.counts.unreadable++;
+
+        close(fd);
+    }
+
+    vector<worker> workers;
+    atomic<size_t> pending{0};
+    atomic<size_t> queued{0};
+    atomic<unsigned> sleepers{0};
+    mutex idle_lock;
+    condition_variable wake;
+};
+
+// Prints the totals of the tree under root; fails when root itself cannot
+// be read, as the walk would only count it as unreadable
+int walk(const char* root, unsigned threads)
+{
+    int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0) {
+        cerr << root << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    close(fd);
+    report(tree_walker(threads).walk(root));
+    return 0;
+}
+
+// Fills root, unless it already exists, with that many sparse files of random
+// sizes and known or unknown extensions, 64 to a directory and 64
+// directories to a parent
+bool make_tree(const string& root, size_t files)
+{
+    if (mkdir(root.c_str(), 0755) != 0)
+        return errno == EEXIST;
+
+    uint64_t x = 88172645463325252ull;
+    string path;
+
+    for (size_t i = 0; i < files; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        auto top = root + "/a" + to_string(i / 4096);
+        auto leaf = top + "/b" + to_string(i / 64 % 64);
+
+        if (i % 4096 == 0)
+            mkdir(top.c_str(), 0755);
+
+        if (i % 64 == 0)
+            mkdir(leaf.c_str(), 0755);
+
+        path = leaf + "/f" + to_string(i);
+
+        if (x % 4)
+            path.append(1, '.').append(builtin_extensions[x / 4 % size(builtin_extensions)].name);
+
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0 || ftruncate(fd, x >> 44) != 0)
+            return false;
+
+        close(fd);
+    }
+
+    return true;
+}
+
+// Walks a generated tree with 1, 2, 4... threads, and once with
+// std::filesystem, which is what a listing producer would do
+int bench_walk(const char* root, size_t files, unsigned max_threads)
+{
+    if (!make_tree(root, files)) {
+        cerr << root << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    auto time = [](auto f) {
+        auto start = chrono::steady_clock::now();
+        auto result = f();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        return make_pair(result, elapsed.count());
+    };
+
+    auto [reference, seconds] = time([root] {
+        totals t;
+
+        for (const auto& entry : filesystem::recursive_directory_iterator(root))
+            if (entry.is_regular_file() && !entry.is_symlink()) {
+                auto cat = catoi(get_category(entry.path().filename().string()));
+
+                t.bytes[cat] += entry.file_size();
+                t.files[cat]++;
+            }
+
+        return t;
+    });
+
+    auto count = accumulate(begin(reference.files), end(reference.files), uint64_t(0));
+    bool ok = true;
+
+    cout << "filesystem: " << count / seconds / 1e6 << " M files/s" << endl;
+
+    for (unsigned threads = 1; ; threads = min(threads * 2, max_threads)) {
+        auto [t, seconds] = time([root, threads] { return tree_walker(threads).walk(root); });
+
+        ok = ok && equal(begin(t.bytes), end(t.bytes), begin(reference.bytes))
+                && equal(begin(t.files), end(t.files), begin(reference.files));
+
+        cout << "walk " << setw(3) << threads << ": " << count / seconds / 1e6 << " M files/s"
+             << endl;
+
+        if (threads == max_threads)
+            break;
+    }
+
+    return ok ? 0 : 1;
+}
+
+// get_category as it was before the registry: a substring search of
+// every category's extensions. Kept to benchmark against.
+const strings legacy_extensions = {
+    "mp4/mkv/avi",
+    "jpg/bmp/gif",
+    "mp3/flac/wav"
+};
+
+category get_category_substring(string_view file_name)
+{
+    category result = category::cat_other;
+    size_t idx = 0;
+
+    if (const auto& ext = extract_extension(file_name);
+            !ext.empty())
+        for (auto& cat : legacy_extensions) {
+            if (cat.find(ext) != string::npos)
+                result = static_cast<category>(idx);
+            else
+                idx++;
+        }
+
+    return result;
+}
+
+template<typename Lookup>
+double time_lookups(const strings& names, unsigned rounds, Lookup lookup, uint64_t& sink)
+{
+    auto start = chrono::steady_clock::now();
+
+    for (unsigned r = 0; r < rounds; r++)
+        for (const auto& name : names)
+            sink += catoi(lookup(name));
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e9 / (double(names.size()) * rounds);
+}
+
+// Classifies random names, with known extensions in both cases, unknown
+// ones and none, through both lookups
+int bench(size_t count, unsigned rounds)
+{
+    const string_view unknown[] = {"txt", "exe", "cpp", "pdf", "zip", "html", "mp", "m", ""};
+    strings names;
+    uint64_t x = 88172645463325252ull;
+
+    for (size_t i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        string name = "file" + to_string(i % 1000);
+        string ext(x % 4 == 0 ? unknown[x / 4 % size(unknown)]
+                              : builtin_extensions[x / 4 % size(builtin_extensions)].name);
+
+        if (x & (1ull << 40))
+            transform(ext.begin(), ext.end(), ext.begin(), ::toupper);
+
+        names.push_back(ext.empty() ? name : name + "." + ext);
+    }
+
+    uint64_t sink = 0;
+    auto substring = time_lookups(names, rounds, get_category_substring, sink);
+    auto hashed = time_lookups(names, rounds, get_category, sink);
+
+    cout << "substring: " << substring << " ns/name" << endl;
+    cout << "  hashed: " << hashed << " ns/name" << endl;
+    cout << "(" << sink << ")" << endl;
+    return 0;
+}
+
+// Reads a thread count, 0 standing for one per core; more than a few
+// threads per core would only wait on each other, so larger counts are cut
+bool parse_threads(const char* text, unsigned& threads)
+{
+    auto cores = max(1u, thread::hardware_concurrency());
+    auto last = text + strlen(text);
+    auto [end, ec] = from_chars(text, last, threads);
+
+    if (ec != errc{} || end == text || end != last)
+        return false;
+
+    threads = threads == 0 ? cores : min(threads, cores * 4);
+    return true;
+}
+
+// Usage: fstats [-c categories] [--threads n]
+//               [-b [names] [rounds] | --walk dir | --bench-walk dir [files] | listing | -]
+//
+// Without a listing, runs the built-in sample; otherwise streams it and
+// prints only the totals. --walk reads the tree under dir instead of a
+// listing of it. -c adds the extensions of a category file to the
+// built-in ones, --threads splits the work between n threads (0 for one
+// per core, at most four per core), -b benchmarks get_category,
+// --bench-walk the tree walk on a tree it generates in dir unless dir
+// exists.
+int main(int argc, char** argv)
+{
+    int arg = 1;
+    unsigned threads = 1;
+
+    for (; arg + 1 < argc; arg += 2) {
+        if (strcmp(argv[arg], "-c") == 0) {
+            if (!load_categories(argv[arg + 1]))
+                return 1;
+        } else if (strcmp(argv[arg], "--threads") == 0) {
+            if (!parse_threads(argv[arg + 1], threads)) {
+                cerr << "--threads " << argv[arg + 1] << ": expected a thread count, 0 for one per core"
+                     << endl;
+                return 1;
+            }
+        } else
+            break;
+    }
+
+    if (arg < argc && strcmp(argv[arg], "-b") == 0) {
+        size_t count = arg + 1 < argc ? strtoul(argv[arg + 1], nullptr, 10) : 1 << 16;
+        unsigned rounds = arg + 2 < argc ? strtoul(argv[arg + 2], nullptr, 10) : 64;
+
+        return bench(count, rounds);
+    }
+
+    if (arg + 1 < argc && strcmp(argv[arg], "--walk") == 0)
+        return walk(argv[arg + 1], threads);
+
+    if (arg + 1 < argc && strcmp(argv[arg], "--bench-walk") == 0) {
+        size_t files = arg + 2 < argc ? strtoul(argv[arg + 2], nullptr, 10) : 1 << 18;
+
+        return bench_walk(argv[arg + 1], files, max(threads, thread::hardware_concurrency()));
+    }
+
+    if (arg < argc)
+        return stream(argv[arg], threads);
+
+    // The sample is a listing like any other, tail without a newline included
+    const string_view sample =
+        "hjhasd.ghsda 12249b\n"
+        "explorer.exe 8299b\n"
+        "newsong.mp3 10000b\n"
+        "thisisnewshit!.flac 200000b\n"
+        "movie.mkv 10000b\n"
+        "dick.jpg 289b\n"
+        "autorun 10b";
+    totals t;
+
+    account(sample.substr(scan(sample, t)), t);
+    report(t);
+    return 0;
 }